@@ -0,0 +1,78 @@
+#include "aot.h"
+#include "dispatch.h"
+#include "strings.h"
+
+// whether memory still holds the code block was compiled from
+static bool block_intact(const chip_t *chip, const aot_program_t *program,
+                         const aot_block_t *block) {
+  const unsigned char *code =
+      program->rom->data + (block->start - PROGRAM_START);
+  return memcmp(chip->MEM + block->start, code, 2 * block->len) == 0;
+}
+
+// attaches the first program for the chip's quirks whose first block is in
+// memory, and marks which of its blocks still match memory. a block that
+// matches runs exactly the code the interpreter would, whichever ROM it came
+// from, so the first block is only there to pick a likely program
+static void attach(chip_t *chip) {
+  aot_state_t *aot = &chip->COMPILED;
+  aot->looked_up = true;
+  for (int p = 0; p < NUM_AOT_PROGRAMS && aot->program == NULL; p++) {
+    const aot_program_t *program = &AOT_PROGRAMS[p];
+    if (program->num_blocks > 0 && program->rom->quirks == chip->QUIRKS &&
+        block_intact(chip, program, &program->blocks[0])) {
+      aot->program = program;
+    }
+  }
+  if (aot->program == NULL) {
+    return;
+  }
+  for (int b = 0; b < aot->program->num_blocks; b++) {
+    const aot_block_t *block = &aot->program->blocks[b];
+    bool intact = block_intact(chip, aot->program, block);
+    aot->dead[block->start] = !intact;
+    if (intact) {
+      for (int a = block->start; a < block->start + 2 * block->len; a++) {
+        aot->covered[a] = true;
+      }
+    }
+  }
+}
+
+void aot_reset(chip_t *chip) {
+  aot_state_t *aot = &chip->COMPILED;
+  aot->program = NULL;
+  aot->looked_up = false;
+  memset(aot->covered, 0, sizeof(aot->covered));
+}
+
+void aot_invalidate(chip_t *chip, unsigned short addr) {
+  aot_state_t *aot = &chip->COMPILED;
+  const aot_program_t *program = aot->program;
+  for (int b = 0; b < program->num_blocks; b++) {
+    const aot_block_t *block = &program->blocks[b];
+    if (addr >= block->start && addr < block->start + 2 * block->len) {
+      aot->dead[block->start] = true;
+    }
+  }
+  aot->covered[addr] = false;
+}
+
+void aot_run(chip_t *chip, unsigned int count) {
+  aot_state_t *aot = &chip->COMPILED;
+  if (!aot->looked_up) {
+    attach(chip);
+  }
+  const aot_program_t *program = aot->program;
+  if (program == NULL) {
+    dispatch_table(chip, count);
+    return;
+  }
+  while (count > 0) {
+    count = program->run(chip, count);
+    if (count > 0) {
+      dispatch_table(chip, 1);
+      count--;
+    }
+  }
+}
@@ -0,0 +1,62 @@
+#ifndef AOT_H
+#define AOT_H
+// ahead-of-time compiled programs
+//
+// the build turns every ROM in roms.c into C with host/recompile
+// (recompiled.c): each basic block reachable from PROGRAM_START through
+// jumps, calls and skips runs its instructions back to back with their
+// operands as constants, and goes straight on to the blocks it can reach,
+// all within one function per program. jumps only known at run time (BNNN,
+// 00EE) look the block for PC up in a switch, so they land on compiled code
+// as well. the interpreter runs everything else: addresses no block starts
+// at, FX0A, blocks longer than the instructions left to run, and blocks
+// whose bytes have been written since the program was loaded
+
+#include "hachip.h"
+#include "opcodes.h"
+#include "roms.h"
+
+typedef struct {
+  unsigned short start;
+  // instructions, all of them run once the block is entered
+  unsigned short len;
+} aot_block_t;
+
+typedef struct aot_program {
+  // the ROM compiled, and the quirks it was compiled for
+  const rom_t *rom;
+  // by start address
+  const aot_block_t *blocks;
+  int num_blocks;
+  // runs blocks from PC on while at most count instructions are left, and
+  // returns how many are, with PC where the interpreter is to take over
+  unsigned int (*run)(chip_t *chip, unsigned int count);
+} aot_program_t;
+
+// one for each ROM in ROMS, generated
+extern const aot_program_t AOT_PROGRAMS[];
+extern const int NUM_AOT_PROGRAMS;
+
+// runs count instructions starting at PC, through the compiled blocks of the
+// program in memory where it can
+void aot_run(chip_t *chip, unsigned int count);
+
+// forgets the program attached to the chip; called whenever memory is
+// replaced wholesale, so the next aot_run matches it against memory afresh
+void aot_reset(chip_t *chip);
+
+// leaves every block holding addr to the interpreter until the next reset;
+// called by write_mem for bytes marked in chip->COMPILED.covered
+void aot_invalidate(chip_t *chip, unsigned short addr);
+
+// opcode decoded as the instruction called name in OPCODE_LIST, for the
+// generated blocks to hand to the exec_ functions in exec.h
+#define AOT_INSTR(name, opcode)                                                \
+  (&(const instr_t){.op = OP_##name,                                           \
+                    .x = ((opcode) >> 8) & 0xF,                                \
+                    .y = ((opcode) >> 4) & 0xF,                                \
+                    .n = (opcode) & 0xF,                                       \
+                    .nn = (opcode) & 0xFF,                                     \
+                    .nnn = (opcode) & 0xFFF})
+
+#endif
@@ -0,0 +1,91 @@
+#include "audio.h"
+#include "strings.h"
+
+// 2^(k / 48) in 16.16 fixed point; the pitch formula in audio.h is this
+// table shifted by whole octaves
+static const uint32_t semitone_steps[48] = {
+    65536,  66489,  67456,  68438,  69433,  70443,  71468,  72507,
+    73562,  74632,  75717,  76819,  77936,  79069,  80220,  81386,
+    82570,  83771,  84990,  86226,  87480,  88752,  90043,  91353,
+    92682,  94030,  95398,  96785,  98193,  99621,  101070, 102540,
+    104032, 105545, 107080, 108638, 110218, 111821, 113448, 115098,
+    116772, 118470, 120194, 121942, 123715, 125515, 127341, 129193,
+};
+
+// pattern bits per sample at pitch, in 16.16 fixed point
+static uint32_t pitch_step(uint8_t pitch) {
+  // pitches 0..255 are -64..191 around 64, kept non-negative for division
+  int shifted = pitch - AUDIO_DEFAULT_PITCH + 2 * 48;
+  int octave = shifted / 48 - 2;
+  uint32_t step = 4000 * semitone_steps[shifted % 48] / AUDIO_SAMPLE_RATE;
+  return octave >= 0 ? step << octave : step >> -octave;
+}
+
+void audio_init(audio_t *audio) {
+  audio->on = false;
+  memset(audio->pattern, 0, sizeof(audio->pattern));
+  audio->pitch = AUDIO_DEFAULT_PITCH;
+  audio->phase = 0;
+  audio->step = pitch_step(AUDIO_DEFAULT_PITCH);
+  audio->step_pitch = AUDIO_DEFAULT_PITCH;
+  // start a full queue behind, so every change posted is heard the same
+  // AUDIO_AHEAD samples later and sounds last as long as they were posted for
+  for (int n = 0; n < AUDIO_AHEAD; n++) {
+    audio->samples[n] = AUDIO_SILENCE;
+  }
+  audio->head = AUDIO_AHEAD;
+  audio->tail = 0;
+  audio->underruns = 0;
+}
+
+void audio_post(audio_t *audio, bool on, const uint8_t *pattern,
+                uint8_t pitch) {
+  audio->on = on;
+  if (on) {
+    memcpy(audio->pattern, pattern, sizeof(audio->pattern));
+    audio->pitch = pitch;
+  }
+}
+
+unsigned int audio_fill(audio_t *audio) {
+  unsigned int head = audio->head;
+  unsigned int queued = head - audio->tail;
+  if (queued >= AUDIO_AHEAD) {
+    return 0;
+  }
+  unsigned int count = AUDIO_AHEAD - queued;
+  if (!audio->on) {
+    for (unsigned int n = 0; n < count; n++) {
+      audio->samples[(head + n) & (AUDIO_BUFFER_SIZE - 1)] = AUDIO_SILENCE;
+    }
+  } else {
+    if (audio->pitch != audio->step_pitch) {
+      audio->step = pitch_step(audio->pitch);
+      audio->step_pitch = audio->pitch;
+    }
+    uint32_t phase = audio->phase;
+    for (unsigned int n = 0; n < count; n++) {
+      unsigned int bit = (phase >> 16) & (AUDIO_PATTERN_SIZE * 8 - 1);
+      bool high = (audio->pattern[bit / 8] >> (7 - bit % 8)) & 1;
+      audio->samples[(head + n) & (AUDIO_BUFFER_SIZE - 1)] =
+          high ? AUDIO_SILENCE + AUDIO_VOLUME : AUDIO_SILENCE - AUDIO_VOLUME;
+      phase += audio->step;
+    }
+    audio->phase = phase;
+  }
+  __asm__ volatile("" ::: "memory");
+  audio->head = head + count;
+  return count;
+}
+
+bool audio_take(audio_t *audio, uint8_t *sample) {
+  unsigned int tail = audio->tail;
+  if (tail == audio->head) {
+    audio->underruns++;
+    return false;
+  }
+  *sample = audio->samples[tail & (AUDIO_BUFFER_SIZE - 1)];
+  __asm__ volatile("" ::: "memory");
+  audio->tail = tail + 1;
+  return true;
+}
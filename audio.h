@@ -0,0 +1,65 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+// sound output pipeline
+//
+// the 60 Hz timer step only posts what should be heard (audio_post). samples
+// are made ahead of time by audio_fill, which the peripherals backend runs
+// between frames, never while instructions execute, and are drained by the
+// output device with audio_take at its own pace. audio_fill is the only
+// writer of head and audio_take the only writer of tail, so the device can
+// drain from an interrupt without a lock; the Pi has a single core, so a
+// compiler barrier is enough to publish a sample
+//
+// sound follows XO-CHIP: a 128-bit pattern is played one bit per step at
+// 4000 * 2^((pitch - 64) / 48) steps per second, bit set = high. chips start
+// with a pattern and pitch that make a 500 Hz square wave, the CHIP-8 buzzer,
+// until F002 and FX3A change them
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define AUDIO_SAMPLE_RATE 8000
+#define AUDIO_PATTERN_SIZE 16 // bytes
+#define AUDIO_DEFAULT_PITCH 64
+// unsigned 8-bit samples
+#define AUDIO_SILENCE 128
+#define AUDIO_VOLUME 64
+#define AUDIO_BUFFER_SIZE 512 // power of two
+// samples audio_fill keeps queued, about three frames; more delays the sound
+// behind the picture, less risks running dry between frames
+#define AUDIO_AHEAD (AUDIO_SAMPLE_RATE / 20)
+
+typedef struct {
+  // last state posted; read by audio_fill only
+  bool on;
+  uint8_t pattern[AUDIO_PATTERN_SIZE];
+  uint8_t pitch;
+
+  // generator: position in the pattern and pattern bits per sample, both in
+  // 16.16 fixed point, with the pitch step was worked out for
+  uint32_t phase;
+  uint32_t step;
+  uint8_t step_pitch;
+
+  volatile uint8_t samples[AUDIO_BUFFER_SIZE];
+  volatile unsigned int head; // written by audio_fill only
+  volatile unsigned int tail; // written by audio_take only
+  // times audio_take found nothing queued
+  volatile unsigned long underruns;
+} audio_t;
+
+void audio_init(audio_t *audio);
+
+// sets what is heard from the next sample made on: the pattern and pitch
+// while on, silence while off
+void audio_post(audio_t *audio, bool on, const uint8_t *pattern,
+                uint8_t pitch);
+
+// queues samples until AUDIO_AHEAD are waiting; returns how many it made
+unsigned int audio_fill(audio_t *audio);
+
+// takes the next queued sample; when there is none, counts an underrun and
+// returns false
+bool audio_take(audio_t *audio, uint8_t *sample);
+
+#endif
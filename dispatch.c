@@ -0,0 +1,181 @@
+#include "dispatch.h"
+#include "exec.h"
+#include "hachip.h"
+#include "opcodes.h"
+#include "predecode.h"
+
+// the table and threaded engines read PREDECODED instead of MEM and do not
+// update OPCODE. PC is masked like every other address: a BNNN past the end
+// of memory or a run off it wraps around instead of reading past PREDECODED
+static inline const instr_t *fetch(chip_t *chip) {
+  const instr_t *in = &chip->PREDECODED[chip->PC & (MEM_SIZE - 1)];
+  chip->PC += 2;
+  return in;
+}
+
+// re-decodes a stale entry in place and returns it
+static inline const instr_t *refresh(chip_t *chip, const instr_t *in) {
+  predecode(chip, in - chip->PREDECODED);
+  return in;
+}
+
+void dispatch_switch(chip_t *chip, unsigned int count) {
+  while (count--) {
+    unsigned short pc = chip->PC & (MEM_SIZE - 1);
+    chip->OPCODE = chip->MEM[pc] << 8 | chip->MEM[(pc + 1) & (MEM_SIZE - 1)];
+    chip->PC += 2;
+    run_opcode(chip);
+  }
+}
+
+typedef void (*handler_t)(chip_t *chip, const instr_t *in);
+
+static void exec_STALE(chip_t *chip, const instr_t *in);
+
+#define OP_HANDLER(name) [OP_##name] = exec_##name,
+static const handler_t handlers[NUM_OPS] = {
+    OPCODE_LIST(OP_HANDLER)[OP_STALE] = exec_STALE};
+#undef OP_HANDLER
+
+static void exec_STALE(chip_t *chip, const instr_t *in) {
+  in = refresh(chip, in);
+  handlers[in->op](chip, in);
+}
+
+void dispatch_table(chip_t *chip, unsigned int count) {
+  while (count--) {
+    const instr_t *in = fetch(chip);
+    handlers[in->op](chip, in);
+  }
+}
+
+// events each op can raise, see stop_t; whether it does is checked after
+// running it
+static const unsigned char op_events[NUM_OPS] = {
+    [OP_UNKNOWN] = STOP_INVALID, [OP_0NNN] = STOP_INVALID,
+    [OP_00E0] = STOP_DISPLAY,    [OP_00CN] = STOP_DISPLAY,
+    [OP_00DN] = STOP_DISPLAY,    [OP_00FB] = STOP_DISPLAY,
+    [OP_00FC] = STOP_DISPLAY,    [OP_00FE] = STOP_DISPLAY,
+    [OP_00FF] = STOP_DISPLAY,    [OP_DXYN] = STOP_DISPLAY,
+    [OP_FX0A] = STOP_KEY_WAIT,   [OP_FX18] = STOP_SOUND,
+};
+
+// the registers dispatch_until keeps in locals that each op uses, read or
+// written through chip by its exec_ body; everything else leaves them alone
+#define USES_PC 1
+#define USES_I 2
+#define USES_SP 4
+static const unsigned char op_uses[NUM_OPS] = {
+    [OP_00EE] = USES_PC | USES_SP, [OP_2NNN] = USES_PC | USES_SP,
+    [OP_00FD] = USES_PC,           [OP_1NNN] = USES_PC,
+    [OP_3XNN] = USES_PC,           [OP_4XNN] = USES_PC,
+    [OP_5XY0] = USES_PC,           [OP_9XY0] = USES_PC,
+    [OP_BNNN] = USES_PC,           [OP_BXNN] = USES_PC,
+    [OP_EX9E] = USES_PC,           [OP_EXA1] = USES_PC,
+    [OP_FX0A] = USES_PC,           [OP_ANNN] = USES_I,
+    [OP_DXYN] = USES_I,            [OP_F002] = USES_I,
+    [OP_FX1E] = USES_I,            [OP_FX29] = USES_I,
+    [OP_FX30] = USES_I,            [OP_FX33] = USES_I,
+    [OP_FX55] = USES_I,            [OP_FX55_INC] = USES_I,
+    [OP_FX65] = USES_I,            [OP_FX65_INC] = USES_I,
+};
+
+unsigned int dispatch_until(chip_t *chip, unsigned int count,
+                            unsigned int stop_on, stop_t *reason) {
+  // held here for the whole batch and stored back on the way out; every
+  // write to V or MEM may alias chip, so the compiler would otherwise reload
+  // PC from memory for every instruction
+  unsigned short pc = chip->PC;
+  unsigned short i = chip->I;
+  unsigned short sp = chip->SP;
+  *reason = STOP_COUNT;
+  unsigned int done = 0;
+  while (done < count) {
+    const instr_t *in = &chip->PREDECODED[pc & (MEM_SIZE - 1)];
+    if (in->op == OP_STALE) {
+      in = refresh(chip, in);
+    }
+    // everything else pays for one table lookup
+    unsigned int events = op_events[in->op] & stop_on;
+    if (events & STOP_INVALID) {
+      *reason = STOP_INVALID;
+      break;
+    }
+    unsigned short at = pc;
+    unsigned char sound = chip->SOUND_TIMER;
+    pc += 2;
+    // op_uses is constant in each case, so only the copies an op needs are
+    // left; the others keep working on the locals alone
+    switch (in->op) {
+#define OP_CASE(name)                                                          \
+  case OP_##name:                                                              \
+    if (op_uses[OP_##name] & USES_PC) {                                        \
+      chip->PC = pc;                                                           \
+    }                                                                          \
+    if (op_uses[OP_##name] & USES_I) {                                         \
+      chip->I = i;                                                             \
+    }                                                                          \
+    if (op_uses[OP_##name] & USES_SP) {                                        \
+      chip->SP = sp;                                                           \
+    }                                                                          \
+    exec_##name(chip, in);                                                     \
+    if (op_uses[OP_##name] & USES_PC) {                                        \
+      pc = chip->PC;                                                           \
+    }                                                                          \
+    if (op_uses[OP_##name] & USES_I) {                                         \
+      i = chip->I;                                                             \
+    }                                                                          \
+    if (op_uses[OP_##name] & USES_SP) {                                        \
+      sp = chip->SP;                                                           \
+    }                                                                          \
+    break;
+      OPCODE_LIST(OP_CASE)
+#undef OP_CASE
+    }
+    done++;
+    if (events == 0) {
+      continue;
+    }
+    if ((events & STOP_DISPLAY) ||
+        ((events & STOP_KEY_WAIT) && pc == at) ||
+        ((events & STOP_SOUND) && sound == 0 && chip->SOUND_TIMER > 0)) {
+      *reason = (stop_t)events;
+      break;
+    }
+  }
+  chip->PC = pc;
+  chip->I = i;
+  chip->SP = sp;
+  return done;
+}
+
+#ifdef __GNUC__
+void dispatch_threaded(chip_t *chip, unsigned int count) {
+#define OP_LABEL(name) [OP_##name] = &&do_##name,
+  static void *const labels[NUM_OPS] = {
+      OPCODE_LIST(OP_LABEL)[OP_STALE] = &&do_STALE};
+#undef OP_LABEL
+  const instr_t *in;
+  // each handler ends in its own fetch/decode/jump, which gives the branch
+  // predictor one indirect jump per opcode instead of a single shared one
+#define NEXT()                                                                 \
+  do {                                                                         \
+    if (count-- == 0) {                                                        \
+      return;                                                                  \
+    }                                                                          \
+    in = fetch(chip);                                                          \
+    goto *labels[in->op];                                                      \
+  } while (0)
+
+  NEXT();
+do_STALE:
+  in = refresh(chip, in);
+  goto *labels[in->op];
+#define OP_BODY(name)                                                          \
+  do_##name : exec_##name(chip, in);                                           \
+  NEXT();
+  OPCODE_LIST(OP_BODY)
+#undef OP_BODY
+#undef NEXT
+}
+#endif
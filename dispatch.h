@@ -0,0 +1,23 @@
+#ifndef DISPATCH_H
+#define DISPATCH_H
+
+#include "hachip.h"
+
+// each engine runs count instructions starting at chip->PC
+// run_opcode's nested switch, kept as the reference implementation
+void dispatch_switch(chip_t *chip, unsigned int count);
+
+// predecoded instructions called through a handler table indexed by op
+void dispatch_table(chip_t *chip, unsigned int count);
+
+// predecoded instructions in a single inlined switch that returns early on
+// the events in stop_on; see emulate_until
+unsigned int dispatch_until(chip_t *chip, unsigned int count,
+                            unsigned int stop_on, stop_t *reason);
+
+#ifdef __GNUC__
+// predecoded instructions with computed-goto jumps between handlers
+void dispatch_threaded(chip_t *chip, unsigned int count);
+#endif
+
+#endif
@@ -0,0 +1,18 @@
+#ifndef DISPLAY_H
+#define DISPLAY_H
+// display geometry shared by the core and the peripherals
+
+// CHIP-8 lo-res mode and the SUPER-CHIP hi-res mode selected by 00FF
+#define DISPLAY_WIDTH 64
+#define DISPLAY_HEIGHT 32
+#define HIRES_WIDTH 128
+#define HIRES_HEIGHT 64
+
+// XO-CHIP bitplanes; a pixel's colour is its bit from each plane
+#define DISPLAY_PLANES 2
+
+// 64-bit words per row, column 0 in the top bit of the first; lo-res rows
+// only use the first word
+#define ROW_WORDS (HIRES_WIDTH / 64)
+
+#endif
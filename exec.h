@@ -0,0 +1,270 @@
+#ifndef EXEC_H
+#define EXEC_H
+// instruction bodies shared by the dispatch engines and the compiled blocks
+// semantics match run_opcode, see the comments there
+//
+// exec_NAME runs the instruction named NAME in OPCODE_LIST with chip->PC
+// already pointing past it
+
+#include "hachip.h"
+#include "opcodes.h"
+#include "predecode.h"
+#include "trace.h"
+
+static inline void exec_UNKNOWN(chip_t *chip, const instr_t *in) {}
+
+static inline void exec_0NNN(chip_t *chip, const instr_t *in) {}
+
+static inline void exec_00E0(chip_t *chip, const instr_t *in) {
+  clear_screen(chip);
+}
+
+static inline void exec_00EE(chip_t *chip, const instr_t *in) {
+  TRACE_ASSERT(chip, chip->SP > 0);
+  chip->PC = chip->STACK[--chip->SP];
+}
+
+static inline void exec_00CN(chip_t *chip, const instr_t *in) {
+  scroll_down(chip, in->n);
+}
+
+static inline void exec_00DN(chip_t *chip, const instr_t *in) {
+  scroll_up(chip, in->n);
+}
+
+static inline void exec_00FB(chip_t *chip, const instr_t *in) {
+  scroll_right(chip);
+}
+
+static inline void exec_00FC(chip_t *chip, const instr_t *in) {
+  scroll_left(chip);
+}
+
+static inline void exec_00FD(chip_t *chip, const instr_t *in) {
+  chip->PC -= 2;
+}
+
+static inline void exec_00FE(chip_t *chip, const instr_t *in) {
+  set_hires(chip, false);
+}
+
+static inline void exec_00FF(chip_t *chip, const instr_t *in) {
+  set_hires(chip, true);
+}
+
+static inline void exec_1NNN(chip_t *chip, const instr_t *in) {
+  chip->PC = in->nnn;
+}
+
+static inline void exec_2NNN(chip_t *chip, const instr_t *in) {
+  TRACE_ASSERT(chip, chip->SP < 15);
+  chip->STACK[chip->SP++] = chip->PC;
+  chip->PC = in->nnn;
+}
+
+static inline void exec_3XNN(chip_t *chip, const instr_t *in) {
+  if (chip->V[in->x] == in->nn) {
+    chip->PC += 2;
+  }
+}
+
+static inline void exec_4XNN(chip_t *chip, const instr_t *in) {
+  if (chip->V[in->x] != in->nn) {
+    chip->PC += 2;
+  }
+}
+
+static inline void exec_5XY0(chip_t *chip, const instr_t *in) {
+  if (chip->V[in->x] == chip->V[in->y]) {
+    chip->PC += 2;
+  }
+}
+
+static inline void exec_6XNN(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] = in->nn;
+}
+
+static inline void exec_7XNN(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] += in->nn;
+}
+
+static inline void exec_8XY0(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] = chip->V[in->y];
+}
+
+static inline void exec_8XY1(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] |= chip->V[in->y];
+}
+
+static inline void exec_8XY2(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] &= chip->V[in->y];
+}
+
+static inline void exec_8XY3(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] ^= chip->V[in->y];
+}
+
+static inline void exec_8XY4(chip_t *chip, const instr_t *in) {
+  chip->V[0xF] = chip->V[in->y] > (0xFF - chip->V[in->x]) ? 1 : 0;
+  chip->V[in->x] += chip->V[in->y];
+}
+
+static inline void exec_8XY5(chip_t *chip, const instr_t *in) {
+  chip->V[0xF] = chip->V[in->x] > chip->V[in->y] ? 1 : 0;
+  chip->V[in->x] -= chip->V[in->y];
+}
+
+static inline void exec_8XY6(chip_t *chip, const instr_t *in) {
+  chip->V[0xF] = chip->V[in->x] & 1;
+  chip->V[in->x] >>= 1;
+}
+
+static inline void exec_8XY6_VY(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] = chip->V[in->y];
+  exec_8XY6(chip, in);
+}
+
+static inline void exec_8XY7(chip_t *chip, const instr_t *in) {
+  chip->V[0xF] = chip->V[in->y] > chip->V[in->x] ? 1 : 0;
+  chip->V[in->x] = chip->V[in->y] - chip->V[in->x];
+}
+
+static inline void exec_8XYE(chip_t *chip, const instr_t *in) {
+  chip->V[0xF] = (chip->V[in->x] & 0x80) >> 7;
+  chip->V[in->x] <<= 1;
+}
+
+static inline void exec_8XYE_VY(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] = chip->V[in->y];
+  exec_8XYE(chip, in);
+}
+
+static inline void exec_9XY0(chip_t *chip, const instr_t *in) {
+  if (chip->V[in->x] != chip->V[in->y]) {
+    chip->PC += 2;
+  }
+}
+
+static inline void exec_ANNN(chip_t *chip, const instr_t *in) {
+  chip->I = in->nnn;
+}
+
+static inline void exec_BNNN(chip_t *chip, const instr_t *in) {
+  chip->PC = in->nnn + chip->V[0];
+}
+
+static inline void exec_BXNN(chip_t *chip, const instr_t *in) {
+  chip->PC = in->nnn + chip->V[in->x];
+}
+
+static inline void exec_CXNN(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] = next_random(chip) & in->nn;
+}
+
+static inline void exec_DXYN(chip_t *chip, const instr_t *in) {
+  draw_sprite(chip, chip->V[in->x], chip->V[in->y], in->n);
+}
+
+static inline void exec_EX9E(chip_t *chip, const instr_t *in) {
+  if (chip->KEYPAD[chip->V[in->x]]) {
+    chip->PC += 2;
+  }
+}
+
+static inline void exec_EXA1(chip_t *chip, const instr_t *in) {
+  if (!chip->KEYPAD[chip->V[in->x]]) {
+    chip->PC += 2;
+  }
+}
+
+static inline void exec_FN01(chip_t *chip, const instr_t *in) {
+  chip->PLANES = in->x & ((1 << DISPLAY_PLANES) - 1);
+}
+
+static inline void exec_F002(chip_t *chip, const instr_t *in) {
+  for (int i = 0; i < AUDIO_PATTERN_SIZE; i++) {
+    chip->AUDIO[i] = chip->MEM[(chip->I + i) & (MEM_SIZE - 1)];
+  }
+}
+
+static inline void exec_FX07(chip_t *chip, const instr_t *in) {
+  chip->V[in->x] = chip->DELAY_TIMER;
+}
+
+static inline void exec_FX0A(chip_t *chip, const instr_t *in) {
+  chip->PC -= 2;
+  for (int i = 0; i < 16; i++) {
+    if (chip->KEYPAD[i]) {
+      chip->V[in->x] = i;
+      chip->PC += 2;
+      break;
+    }
+  }
+}
+
+static inline void exec_FX15(chip_t *chip, const instr_t *in) {
+  chip->DELAY_TIMER = chip->V[in->x];
+}
+
+static inline void exec_FX18(chip_t *chip, const instr_t *in) {
+  chip->SOUND_TIMER = chip->V[in->x];
+}
+
+static inline void exec_FX1E(chip_t *chip, const instr_t *in) {
+  chip->V[0xF] = (chip->V[in->x] > 0x0FFF - chip->I) ? 1 : 0;
+  chip->I += chip->V[in->x];
+}
+
+static inline void exec_FX29(chip_t *chip, const instr_t *in) {
+  chip->I = FONT_START + chip->V[in->x] * 5;
+}
+
+static inline void exec_FX30(chip_t *chip, const instr_t *in) {
+  chip->I = BIG_FONT_START + (chip->V[in->x] & 0xF) * 10;
+}
+
+static inline void exec_FX33(chip_t *chip, const instr_t *in) {
+  write_mem(chip, chip->I, chip->V[in->x] / 100);
+  write_mem(chip, chip->I + 1, (chip->V[in->x] / 10) % 10);
+  write_mem(chip, chip->I + 2, (chip->V[in->x] % 100) % 10);
+}
+
+static inline void exec_FX3A(chip_t *chip, const instr_t *in) {
+  chip->PITCH = chip->V[in->x];
+}
+
+static inline void exec_FX55(chip_t *chip, const instr_t *in) {
+  for (int i = 0; i <= in->x; i++) {
+    write_mem(chip, chip->I + i, chip->V[i]);
+  }
+}
+
+static inline void exec_FX55_INC(chip_t *chip, const instr_t *in) {
+  exec_FX55(chip, in);
+  chip->I += in->x + 1;
+}
+
+static inline void exec_FX65(chip_t *chip, const instr_t *in) {
+  for (int i = 0; i <= in->x; i++) {
+    chip->V[i] = chip->MEM[(chip->I + i) & (MEM_SIZE - 1)];
+  }
+}
+
+static inline void exec_FX65_INC(chip_t *chip, const instr_t *in) {
+  exec_FX65(chip, in);
+  chip->I += in->x + 1;
+}
+
+static inline void exec_FX75(chip_t *chip, const instr_t *in) {
+  for (int i = 0; i <= in->x; i++) {
+    chip->FLAGS[i] = chip->V[i];
+  }
+}
+
+static inline void exec_FX85(chip_t *chip, const instr_t *in) {
+  for (int i = 0; i <= in->x; i++) {
+    chip->V[i] = chip->FLAGS[i];
+  }
+}
+
+#endif
@@ -1,370 +1,655 @@
 #include "hachip.h"
+#include "aot.h"
 #include "assert.h"
+#include "dispatch.h"
+#include "jit.h"
 #include "peripherals.h"
-#include "printf.h"
-#include "roms.h"
+#include "predecode.h"
+#include "trace.h"
 #include "strings.h"
 #include "timer.h"
 
-#define DISPLAY_WIDTH 64
-#define DISPLAY_HEIGHT 32
+#define DISPATCH_SWITCH 0
+#define DISPATCH_TABLE 1
+#define DISPATCH_THREADED 2
+// engine used by emulate_cycles; the switch in run_opcode is the reference
+#ifdef __GNUC__
+#define DISPATCH DISPATCH_THREADED
+#else
+#define DISPATCH DISPATCH_TABLE
+#endif
 
-#define SHIFT_LEGACY_BEHAVIOR false
-#define BNNN_LEGACY_BEHAVIOR false
-#define STR_LDR_LEGACY_BEHAVIOR false
+unsigned char font[80] = {
+    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
+    0x20, 0x60, 0x20, 0x20, 0x70, // 1
+    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
+    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
+    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
+    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
+    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
+    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
+    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
+    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
+    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
+    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
+    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
+    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
+    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
+    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+};
 
-// #define DEBUG true
+// SUPER-CHIP 8x10 digits, with XO-CHIP's A-F
+unsigned char big_font[160] = {
+    0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+    0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+    0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+    0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+    0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+    0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+    0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+    0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+    0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+    0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+    0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0  // F
+};
 
-#ifdef DEBUG
-#define DEBUG_PRINT(x) printf x
-#else
-#define DEBUG_PRINT(x)                                                         \
-  do {                                                                         \
-  } while (0)
+static void peripherals_update_display(chip_t *chip, uint64_t dirty) {
+  update_display((const uint64_t(*)[HIRES_HEIGHT][ROW_WORDS])chip->PIXELS,
+                 chip->HIRES ? HIRES_WIDTH : DISPLAY_WIDTH,
+                 chip->HIRES ? HIRES_HEIGHT : DISPLAY_HEIGHT, dirty);
+}
+
+static void peripherals_set_keys(chip_t *chip, bool *keypad) {
+  set_keys(keypad);
+}
+
+static void peripherals_play_sound(chip_t *chip, bool on) {
+  play_sound(on, chip->AUDIO, chip->PITCH);
+}
+
+const chip_io_t PERIPHERALS_IO = {
+    .update_display = peripherals_update_display,
+    .set_keys = peripherals_set_keys,
+    .play_sound = peripherals_play_sound,
+};
+
+void init_chip(chip_t *chip, const chip_io_t *io) {
+  chip->IO = io;
+  chip->TRANSLATED = NULL;
+  chip->TRACE = NULL;
+#ifdef PROFILING
+  chip->PROFILE = NULL;
 #endif
+  chip->OPCODE = 0;
+  chip->PC = PROGRAM_START;
+  chip->I = 0;
+  chip->SP = 0;
+  memset(chip->MEM, 0, sizeof(chip->MEM));
+  memset(chip->V, 0, sizeof(chip->V));
+  memset(chip->STACK, 0, sizeof(chip->STACK));
+  memset(chip->PIXELS, 0, sizeof(chip->PIXELS));
+  chip->DIRTY = ~(uint64_t)0;
+  chip->HIRES = false;
+  chip->PLANES = 1;
+  memset(chip->KEYPAD, false, 16);
+  chip->DELAY_TIMER = 0;
+  chip->SOUND_TIMER = 0;
+  // the CHIP-8 buzzer, see audio.h
+  memset(chip->AUDIO, 0xF0, sizeof(chip->AUDIO));
+  chip->PITCH = AUDIO_DEFAULT_PITCH;
+  memset(chip->FLAGS, 0, sizeof(chip->FLAGS));
+  chip->QUIRKS = QUIRKS_CHIP8;
+  seed_random(chip, DEFAULT_SEED);
+  for (int i = 0; i < 80; i++) {
+    chip->MEM[i + FONT_START] = font[i];
+  }
+  for (int i = 0; i < 160; i++) {
+    chip->MEM[i + BIG_FONT_START] = big_font[i];
+  }
+  predecode_all(chip);
+  aot_reset(chip);
+}
 
-#define FONT_START 0x50
-void init_chip(void) {
-  CHIP.OPCODE = 0;
-  CHIP.PC = 0x200;
-  CHIP.I = 0;
-  CHIP.SP = 0;
-  memset(CHIP.MEM, 0, sizeof(CHIP.MEM));
-  memset(CHIP.V, 0, sizeof(CHIP.V));
-  memset(CHIP.STACK, 0, sizeof(CHIP.STACK));
-  for (int i = 0; i < DISPLAY_HEIGHT; i++) {
-    memset(CHIP.PIXELS + i, false, DISPLAY_WIDTH);
+void seed_random(chip_t *chip, uint32_t seed) {
+  // xorshift never leaves 0
+  chip->RNG = seed != 0 ? seed : DEFAULT_SEED;
+}
+
+void load_program(chip_t *chip, const unsigned char *program, size_t size,
+                  quirks_t quirks) {
+  assert(size <= MEM_SIZE - PROGRAM_START);
+  memcpy(chip->MEM + PROGRAM_START, program, size);
+  chip->QUIRKS = quirks;
+  predecode_all(chip);
+  aot_reset(chip);
+  jit_reset(chip);
+}
+
+void tick_timers(chip_t *chip) {
+  if (chip->DELAY_TIMER > 0) {
+    chip->DELAY_TIMER--;
   }
-  memset(CHIP.KEYPAD, false, 16);
-  for (int i = 0; i < 80; i++) {
-    CHIP.MEM[i + FONT_START] = font[i];
+  // the buzzer sounds for as many ticks as the timer was set to
+  bool on = chip->SOUND_TIMER > 0;
+  if (on) {
+    chip->SOUND_TIMER--;
+  }
+  chip->IO->play_sound(chip, on);
+}
+
+void flush_display(chip_t *chip) {
+  if (chip->DIRTY) {
+    chip->IO->update_display(chip, chip->DIRTY);
+    chip->DIRTY = 0;
+  }
+}
+
+// rows of the current mode, as a DIRTY mask
+static inline uint64_t mode_rows(const chip_t *chip) {
+  return chip->HIRES ? ~(uint64_t)0 : ((uint64_t)1 << DISPLAY_HEIGHT) - 1;
+}
+
+static inline int mode_height(const chip_t *chip) {
+  return chip->HIRES ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+}
+
+void clear_screen(chip_t *chip) {
+  // lo-res rows never use their second word
+  int height = mode_height(chip);
+  int words = chip->HIRES ? ROW_WORDS : 1;
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    if (!(chip->PLANES & (1 << p))) {
+      continue;
+    }
+    for (int y = 0; y < height; y++) {
+      for (int w = 0; w < words; w++) {
+        if (chip->PIXELS[p][y][w]) {
+          chip->PIXELS[p][y][w] = 0;
+          chip->DIRTY |= (uint64_t)1 << y;
+        }
+      }
+    }
+  }
+}
+
+void draw_sprite(chip_t *chip, unsigned char vx, unsigned char vy,
+                 int height) {
+  // the start position wraps around the screen, the sprite itself is clipped
+  // at the right and bottom edges
+  int x = vx & ((chip->HIRES ? HIRES_WIDTH : DISPLAY_WIDTH) - 1);
+  int y = vy & (mode_height(chip) - 1);
+  int rows = mode_height(chip) - y;
+  // DXY0 draws 16x16, two bytes per row
+  int bytes = 1;
+  if (height == 0) {
+    height = 16;
+    bytes = 2;
+  }
+  if (rows > height) {
+    rows = height;
+  }
+
+  unsigned short addr = chip->I;
+  bool collision = false;
+  if (!chip->HIRES && chip->PLANES == 1 && bytes == 1) {
+    // plain CHIP-8: one plane, one word per row
+    uint64_t(*pixels)[ROW_WORDS] = &chip->PIXELS[0][y];
+    for (int row = 0; row < rows; row++) {
+      uint64_t bits = (uint64_t)chip->MEM[(addr + row) & 0xFFF] << 56 >> x;
+      if (bits) {
+        collision |= (pixels[row][0] & bits) != 0;
+        pixels[row][0] ^= bits;
+        chip->DIRTY |= (uint64_t)1 << (y + row);
+      }
+    }
+    chip->V[0xF] = collision;
+    return;
+  }
+
+  // each selected plane takes the next height * bytes bytes of sprite data
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    if (!(chip->PLANES & (1 << p))) {
+      continue;
+    }
+    uint64_t(*pixels)[ROW_WORDS] = &chip->PIXELS[p][y];
+    for (int row = 0; row < rows; row++) {
+      unsigned short at = addr + row * bytes;
+      uint64_t sprite = (uint64_t)chip->MEM[at & 0xFFF] << 56;
+      if (bytes == 2) {
+        sprite |= (uint64_t)chip->MEM[(at + 1) & 0xFFF] << 48;
+      }
+      // column 0 is the top bit, so bits shifted past bit 0 of the last word
+      // are off-screen; lo-res rows only have the first word
+      uint64_t left = 0;
+      uint64_t right = 0;
+      if (x < 64) {
+        left = sprite >> x;
+        if (chip->HIRES && x > 0) {
+          right = sprite << (64 - x);
+        }
+      } else {
+        right = sprite >> (x - 64);
+      }
+      if (left | right) {
+        collision |= ((pixels[row][0] & left) | (pixels[row][1] & right)) != 0;
+        pixels[row][0] ^= left;
+        pixels[row][1] ^= right;
+        chip->DIRTY |= (uint64_t)1 << (y + row);
+      }
+    }
+    addr += height * bytes;
+  }
+  chip->V[0xF] = collision;
+}
+
+// scrolling moves whole rows, or whole words within a row, per plane; the
+// distances are in pixels of the current mode
+void scroll_down(chip_t *chip, int rows) {
+  int height = mode_height(chip);
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    if (!(chip->PLANES & (1 << p))) {
+      continue;
+    }
+    uint64_t(*pixels)[ROW_WORDS] = chip->PIXELS[p];
+    for (int y = height - 1; y >= 0; y--) {
+      pixels[y][0] = y >= rows ? pixels[y - rows][0] : 0;
+      pixels[y][1] = y >= rows ? pixels[y - rows][1] : 0;
+    }
+  }
+  if (rows > 0) {
+    chip->DIRTY |= mode_rows(chip);
+  }
+}
+
+void scroll_up(chip_t *chip, int rows) {
+  int height = mode_height(chip);
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    if (!(chip->PLANES & (1 << p))) {
+      continue;
+    }
+    uint64_t(*pixels)[ROW_WORDS] = chip->PIXELS[p];
+    for (int y = 0; y < height; y++) {
+      pixels[y][0] = y + rows < height ? pixels[y + rows][0] : 0;
+      pixels[y][1] = y + rows < height ? pixels[y + rows][1] : 0;
+    }
+  }
+  if (rows > 0) {
+    chip->DIRTY |= mode_rows(chip);
   }
 }
 
-void load_program(unsigned short *program, size_t size) {
-  // roms are currently stored as array of unsigned short
-  // CHIP-8 is big endian; convert when loading
-  for (int i = 0; i < size; i++) {
-    unsigned short val = *(program + i);
-    *(program + i) = (val >> 8) | (val << 8);
+void scroll_right(chip_t *chip) {
+  int height = mode_height(chip);
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    if (!(chip->PLANES & (1 << p))) {
+      continue;
+    }
+    uint64_t(*pixels)[ROW_WORDS] = chip->PIXELS[p];
+    for (int y = 0; y < height; y++) {
+      // in lo-res the second word is always empty and stays so
+      if (chip->HIRES) {
+        pixels[y][1] = pixels[y][1] >> 4 | pixels[y][0] << 60;
+      }
+      pixels[y][0] >>= 4;
+    }
   }
-  memcpy(CHIP.MEM + 0x200, program, size);
+  chip->DIRTY |= mode_rows(chip);
 }
 
-void emulate_cycle(void) {
-  DEBUG_PRINT(("---Cycle start:---\n"));
-  CHIP.OPCODE = CHIP.MEM[CHIP.PC] << 8 | CHIP.MEM[CHIP.PC + 1];
-  CHIP.PC += 2;
-  run_opcode();
-  DEBUG_PRINT(("Opcode: %04x\n", CHIP.OPCODE));
-  DEBUG_PRINT(("PC: %d\nI:%d\n", CHIP.PC, CHIP.I));
-  for (int i = 0; i < 16; i++) {
-    DEBUG_PRINT(("V[%x]: %d\n", i, CHIP.V[i]));
+void scroll_left(chip_t *chip) {
+  int height = mode_height(chip);
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    if (!(chip->PLANES & (1 << p))) {
+      continue;
+    }
+    uint64_t(*pixels)[ROW_WORDS] = chip->PIXELS[p];
+    for (int y = 0; y < height; y++) {
+      pixels[y][0] = pixels[y][0] << 4 | pixels[y][1] >> 60;
+      pixels[y][1] <<= 4;
+    }
   }
+  chip->DIRTY |= mode_rows(chip);
+}
+
+void set_hires(chip_t *chip, bool hires) {
+  // as in Octo and XO-CHIP, switching clears every plane
+  chip->HIRES = hires;
+  memset(chip->PIXELS, 0, sizeof(chip->PIXELS));
+  chip->DIRTY = ~(uint64_t)0;
+}
+
+void emulate_cycles(chip_t *chip, unsigned int count) {
+#if DISPATCH == DISPATCH_THREADED
+  dispatch_threaded(chip, count);
+#elif DISPATCH == DISPATCH_TABLE
+  dispatch_table(chip, count);
+#else
+  dispatch_switch(chip, count);
+#endif
 }
 
-#define X ((CHIP.OPCODE & 0x0F00) >> 8)
-#define Y ((CHIP.OPCODE & 0x00FF) >> 4)
-#define NN (CHIP.OPCODE & 0x00FF)
-#define NNN (CHIP.OPCODE & 0x0FFF)
+unsigned int emulate_until(chip_t *chip, unsigned int count,
+                           unsigned int stop_on, stop_t *reason) {
+  return dispatch_until(chip, count, stop_on, reason);
+}
+
+void emulate_cycle(chip_t *chip) {
+  unsigned short pc = chip->PC & (MEM_SIZE - 1);
+  chip->OPCODE = chip->MEM[pc] << 8 | chip->MEM[(pc + 1) & (MEM_SIZE - 1)];
+  chip->PC += 2;
+  run_opcode(chip);
+}
+
+#define X ((chip->OPCODE & 0x0F00) >> 8)
+#define Y ((chip->OPCODE & 0x00FF) >> 4)
+#define NN (chip->OPCODE & 0x00FF)
+#define NNN (chip->OPCODE & 0x0FFF)
 // https://github.com/mattmikolay/chip-8/wiki/CHIP%E2%80%908-Instruction-Set
-void run_opcode() {
-  switch (CHIP.OPCODE & 0xF000) {
+//
+// the quirk profile is checked as each instruction runs here; the predecoded
+// engines settle it once, when decoding (see quirks_t)
+void run_opcode(chip_t *chip) {
+  switch (chip->OPCODE & 0xF000) {
   case 0:
-    if (CHIP.OPCODE & 0x0F00) {
+    if (chip->OPCODE & 0x0F00) {
       // 0NNN: Execute machine language subroutine at address NNN
       // Unimplemented
-      DEBUG_PRINT(("Executed 0NNN\n"));
       break;
-    } else {
-      if (CHIP.OPCODE & 0x000F) {
-        // 00EE: Return from a subroutine
-        assert(CHIP.SP > 0);
-        CHIP.PC = CHIP.STACK[--CHIP.SP];
-        DEBUG_PRINT(("Executed 00EE\n"));
-      } else {
-        // 00E0: Clear the screen
-        for (int i = 0; i < DISPLAY_HEIGHT; i++) {
-          memset(CHIP.PIXELS + i, false, DISPLAY_WIDTH);
-        }
-        clear_display();
-        DEBUG_PRINT(("Executed 00E0\n"));
-      }
+    }
+    if ((chip->OPCODE & 0x00F0) == 0x00C0) {
+      // 00CN: Scroll the display down N pixels (SUPER-CHIP)
+      scroll_down(chip, chip->OPCODE & 0x000F);
+      break;
+    }
+    if ((chip->OPCODE & 0x00F0) == 0x00D0) {
+      // 00DN: Scroll the display up N pixels (XO-CHIP)
+      scroll_up(chip, chip->OPCODE & 0x000F);
+      break;
+    }
+    switch (NN) {
+    case 0xE0:
+      // 00E0: Clear the screen
+      clear_screen(chip);
+      break;
+    case 0xEE:
+      // 00EE: Return from a subroutine
+      TRACE_ASSERT(chip, chip->SP > 0);
+      chip->PC = chip->STACK[--chip->SP];
+      break;
+    case 0xFB:
+      // 00FB: Scroll the display right 4 pixels (SUPER-CHIP)
+      scroll_right(chip);
+      break;
+    case 0xFC:
+      // 00FC: Scroll the display left 4 pixels (SUPER-CHIP)
+      scroll_left(chip);
+      break;
+    case 0xFD:
+      // 00FD: Exit the interpreter (SUPER-CHIP)
+      //       Stays on this instruction
+      chip->PC -= 2;
+      break;
+    case 0xFE:
+      // 00FE: Switch to 64x32 lo-res mode (SUPER-CHIP)
+      set_hires(chip, false);
+      break;
+    case 0xFF:
+      // 00FF: Switch to 128x64 hi-res mode (SUPER-CHIP)
+      set_hires(chip, true);
+      break;
     }
     break;
   case 0x1000:
     // 1NNN: Jump to address NNN
-    CHIP.PC = NNN;
-    DEBUG_PRINT(("Executed 1NNN\n"));
+    chip->PC = NNN;
     break;
   case 0x2000:
     // 2NNN: Execute subroutine starting at address NNN
-    assert(CHIP.SP < 15);
-    CHIP.STACK[CHIP.SP++] = CHIP.PC;
-    CHIP.PC = NNN;
-    DEBUG_PRINT(("Executed 2NNN\n"));
+    TRACE_ASSERT(chip, chip->SP < 15);
+    chip->STACK[chip->SP++] = chip->PC;
+    chip->PC = NNN;
     break;
   case 0x3000:
     // 3XNN: Skip the following instruction if the value of register VX equals
     // NN
-    if (CHIP.V[X] == NN) {
-      CHIP.PC += 2;
+    if (chip->V[X] == NN) {
+      chip->PC += 2;
     }
-    DEBUG_PRINT(("Executed 3XNN\n"));
     break;
   case 0x4000:
     // 4XNN: Skip the following instruction if the value of register VX is not
     // equal to NN
-    if (CHIP.V[X] != NN) {
-      CHIP.PC += 2;
+    if (chip->V[X] != NN) {
+      chip->PC += 2;
     }
-    DEBUG_PRINT(("Executed 4XNN\n"));
     break;
   case 0x5000:
     // 5XY0: Skip the following instruction if the value of register VX is equal
     // to the value of register VY
-    if (CHIP.V[X] == CHIP.V[Y]) {
-      CHIP.PC += 2;
+    if (chip->V[X] == chip->V[Y]) {
+      chip->PC += 2;
     }
-    DEBUG_PRINT(("Executed 5XY0\n"));
     break;
   case 0x6000:
     // 6XNN: Store number NN in register VX
-    CHIP.V[X] = NN;
-    DEBUG_PRINT(("Executed 6XNN\n"));
+    chip->V[X] = NN;
     break;
   case 0x7000:
     // 7XNN: Add the value NN to register VX
     // does not set carry flag
-    CHIP.V[X] += NN;
-    DEBUG_PRINT(("Executed 7XNN\n"));
+    chip->V[X] += NN;
     break;
   case 0x8000:
-    switch (CHIP.OPCODE & 0x000F) {
+    switch (chip->OPCODE & 0x000F) {
     case 0:
       // 8XY0: Store the value of register VY in register VX
-      CHIP.V[X] = CHIP.V[Y];
-      DEBUG_PRINT(("Executed 8XY0\n"));
+      chip->V[X] = chip->V[Y];
       break;
     case 1:
       // 8XY1: Set VX to VX OR VY
-      CHIP.V[X] |= CHIP.V[Y];
-      DEBUG_PRINT(("Executed 8XY1\n"));
+      chip->V[X] |= chip->V[Y];
       break;
     case 2:
       // 8XY2: Set VX to VX AND VY
-      CHIP.V[X] &= CHIP.V[Y];
-      DEBUG_PRINT(("Executed 8XY2\n"));
+      chip->V[X] &= chip->V[Y];
       break;
     case 3:
       // 8XY3: Set VX to VX XOR VY
-      CHIP.V[X] ^= CHIP.V[Y];
-      DEBUG_PRINT(("Executed 8XY3\n"));
+      chip->V[X] ^= chip->V[Y];
       break;
     case 4:
       // 8XY4: Add the value of register VY to register VX
       //       Set VF to 01 if a carry occurs
       //       Set VF to 00 if a carry does not occur
-      CHIP.V[0XF] = CHIP.V[Y] > (0xFF - CHIP.V[X]) ? 1 : 0;
-      CHIP.V[X] += CHIP.V[Y];
-      DEBUG_PRINT(("Executed 8XY4\n"));
+      chip->V[0XF] = chip->V[Y] > (0xFF - chip->V[X]) ? 1 : 0;
+      chip->V[X] += chip->V[Y];
       break;
     case 5:
       // 8XY5: Subtract the value of register VY from register VX
       //       Set VF to 00 if a borrow occurs
       //       Set VF to 01 if a borrow does not occur
-      CHIP.V[0xF] = CHIP.V[X] > CHIP.V[Y] ? 1 : 0;
-      CHIP.V[X] -= CHIP.V[Y];
-      DEBUG_PRINT(("Executed 8XY5\n"));
+      chip->V[0xF] = chip->V[X] > chip->V[Y] ? 1 : 0;
+      chip->V[X] -= chip->V[Y];
       break;
     case 6:
       // 8XY6: Store the value of register VY shifted right one bit in register
       //       VX
       //       Set register VF to the least significant bit prior to the shift
       //       VY is unchanged
-      if (SHIFT_LEGACY_BEHAVIOR) {
-        CHIP.V[X] = CHIP.V[Y];
+      if (chip->QUIRKS != QUIRKS_SCHIP) {
+        chip->V[X] = chip->V[Y];
       }
-      CHIP.V[0xF] = CHIP.V[X] & 1;
-      CHIP.V[X] >>= 1;
-      DEBUG_PRINT(("Executed 8XY6\n"));
+      chip->V[0xF] = chip->V[X] & 1;
+      chip->V[X] >>= 1;
       break;
     case 7:
       // 8XY7: Set register VX to the value of VY minus VX
       //       Set VF to 00 if a borrow occurs
       //       Set VF to 01 if a borrow does not occur
-      CHIP.V[0xF] = CHIP.V[Y] > CHIP.V[X] ? 1 : 0;
-      CHIP.V[X] = CHIP.V[Y] - CHIP.V[X];
-      DEBUG_PRINT(("Executed 8XY7\n"));
+      chip->V[0xF] = chip->V[Y] > chip->V[X] ? 1 : 0;
+      chip->V[X] = chip->V[Y] - chip->V[X];
       break;
     case 0xE:
       // 8XYE: Store the value of register VY shifted left one bit in register
       // VX¹
       //       Set register VF to the most significant bit prior to the shift
       //       VY is unchanged
-      if (SHIFT_LEGACY_BEHAVIOR) {
-        CHIP.V[X] = CHIP.V[Y];
+      if (chip->QUIRKS != QUIRKS_SCHIP) {
+        chip->V[X] = chip->V[Y];
       }
-      CHIP.V[0xF] = (CHIP.V[X] & 0x80) >> 7;
-      CHIP.V[X] <<= 1;
-      DEBUG_PRINT(("Executed 8XYE\n"));
+      chip->V[0xF] = (chip->V[X] & 0x80) >> 7;
+      chip->V[X] <<= 1;
       break;
     }
     break;
   case 0x9000:
     // 9XY0: Skip the following instruction if the value of register VX is not
     //       equal to the value of register VY
-    if (CHIP.V[X] != CHIP.V[Y]) {
-      CHIP.PC += 2;
+    if (chip->V[X] != chip->V[Y]) {
+      chip->PC += 2;
     }
-    DEBUG_PRINT(("Executed 9XY0\n"));
     break;
   case 0xA000:
     // ANNN: Store memory address NNN in register I
-    CHIP.I = NNN;
-    DEBUG_PRINT(("Executed ANNN\n"));
+    chip->I = NNN;
     break;
   case 0xB000:
     // BNNN: Jump to address NNN + V0
-    if (BNNN_LEGACY_BEHAVIOR) {
-      CHIP.PC = NNN + CHIP.V[0];
+    //       SUPER-CHIP reads it as BXNN, a jump to XNN + VX
+    if (chip->QUIRKS != QUIRKS_SCHIP) {
+      chip->PC = NNN + chip->V[0];
     } else {
-      CHIP.PC = NNN + CHIP.V[X];
+      chip->PC = NNN + chip->V[X];
     }
-    DEBUG_PRINT(("Executed B000\n"));
     break;
   case 0xC000:
     // CXNN: Set VX to a random number with a mask of NN
-    // No ready RNG implementation; just get end of system ticks
-    CHIP.V[X] = timer_get_ticks() & NN;
-    DEBUG_PRINT(("Executed C000\n"));
+    chip->V[X] = next_random(chip) & NN;
     break;
   case 0xD000:
     // DXYN: Draw a sprite at position VX, VY with N bytes of sprite data
     //       starting at the address stored in I
     //       Set VF to 01 if any set pixels are changed to unset, and 00
     //       otherwise
-    {
-      int x = CHIP.V[X] & (DISPLAY_WIDTH - 1);
-      int y = CHIP.V[Y] & (DISPLAY_HEIGHT - 1);
-      int height = CHIP.OPCODE & 0x000F;
-      CHIP.V[0xf] = 0;
-      for (int row = 0; row < height; row++) {
-        unsigned char sprite = CHIP.MEM[CHIP.I + row];
-        for (int col = 0; col < 8; col++) {
-          if (sprite & (0x80 >> col)) {
-            bool pixel = CHIP.PIXELS[y + row][x + col];
-            if (pixel) {
-              CHIP.V[0xF] = 1;
-              draw_pixel(x + col, y + row, false);
-            } else {
-              draw_pixel(x + col, y + row, true);
-            }
-            CHIP.PIXELS[y + row][x + col] = !pixel;
-          }
-          if (x + col == DISPLAY_WIDTH) {
-            break;
-          }
-        }
-        if (y + row == DISPLAY_HEIGHT) {
-          break;
-        }
-      }
-      DEBUG_PRINT(("Executed DXYN\n"));
-    }
+    draw_sprite(chip, chip->V[X], chip->V[Y], chip->OPCODE & 0x000F);
     break;
   case 0xE000:
-    switch (CHIP.OPCODE & 0xFF) {
+    switch (chip->OPCODE & 0xFF) {
     case 0x9E:
       // EX9E: Skip the following instruction if the key corresponding to the
       //       hex value currently stored in register VX is pressed
-      if (CHIP.KEYPAD[CHIP.V[X]]) {
-        CHIP.PC += 2;
+      if (chip->KEYPAD[chip->V[X]]) {
+        chip->PC += 2;
       }
-      DEBUG_PRINT(("Executed EX9E\n"));
       break;
     case 0xA1:
       // EXA1: Skip the following instruction if the key corresponding to the
       //       hex value currently stored in register VX is not pressed
-      if (!CHIP.KEYPAD[CHIP.V[X]]) {
-        CHIP.PC += 2;
+      if (!chip->KEYPAD[chip->V[X]]) {
+        chip->PC += 2;
       }
-      DEBUG_PRINT(("Executed EXA1\n"));
       break;
     }
     break;
   case 0xF000:
-    switch (CHIP.OPCODE & 0xFF) {
+    switch (chip->OPCODE & 0xFF) {
     case 0x07:
       // FX07: Store the current value of the delay timer in register VX
-      CHIP.V[X] = CHIP.DELAY_TIMER;
-      DEBUG_PRINT(("Executed FX07\n"));
+      chip->V[X] = chip->DELAY_TIMER;
       break;
     case 0x0A:
       // FX0A: Wait for a keypress and store the result in register VX
-      CHIP.PC -= 2;
+      chip->PC -= 2;
       for (int i = 0; i < 16; i++) {
-        if (CHIP.KEYPAD[i]) {
-          CHIP.V[X] = i;
-          CHIP.PC += 2;
+        if (chip->KEYPAD[i]) {
+          chip->V[X] = i;
+          chip->PC += 2;
           break;
         }
       }
-      DEBUG_PRINT(("Executed FX0A\n"));
       break;
     case 0x15:
       // FX15: Set the delay timer to the value of register VX
-      CHIP.DELAY_TIMER = CHIP.V[X];
-      DEBUG_PRINT(("Executed FX15\n"));
+      chip->DELAY_TIMER = chip->V[X];
       break;
     case 0x18:
       // FX18: Set the sound timer to the value of register VX
-      CHIP.SOUND_TIMER = CHIP.V[X];
-      DEBUG_PRINT(("Executed FX18\n"));
+      chip->SOUND_TIMER = chip->V[X];
       break;
     case 0x1E:
       // FX1E: Add the value stored in register VX to register I
-      CHIP.V[0xF] = (CHIP.V[X] > 0x0FFF - CHIP.I) ? 1 : 0;
-      CHIP.I += CHIP.V[X];
-      DEBUG_PRINT(("Executed FX1E\n"));
+      chip->V[0xF] = (chip->V[X] > 0x0FFF - chip->I) ? 1 : 0;
+      chip->I += chip->V[X];
+      break;
+    case 0x01:
+      // FN01: Select the bitplanes N to draw to (XO-CHIP)
+      chip->PLANES = X & ((1 << DISPLAY_PLANES) - 1);
+      break;
+    case 0x02:
+      // F002: Load the 16-byte audio pattern starting at I (XO-CHIP)
+      for (int i = 0; i < AUDIO_PATTERN_SIZE; i++) {
+        chip->AUDIO[i] = chip->MEM[(chip->I + i) & (MEM_SIZE - 1)];
+      }
       break;
     case 0x29:
       // FX29: Set I to the memory address of the sprite data corresponding to
       //       the hexadecimal digit stored in register VX
-      CHIP.I = FONT_START + CHIP.V[X] * 5;
-      DEBUG_PRINT(("Executed FX29\n"));
+      chip->I = FONT_START + chip->V[X] * 5;
+      break;
+    case 0x30:
+      // FX30: Set I to the 8x10 sprite for the hexadecimal digit in VX
+      //       (SUPER-CHIP)
+      chip->I = BIG_FONT_START + (chip->V[X] & 0xF) * 10;
       break;
     case 0x33:
       // FX33: Store the binary-coded decimal equivalent of the value stored in
       //       register VX at addresses I, I + 1, and I + 2
-      CHIP.MEM[CHIP.I] = CHIP.V[X] / 100;
-      CHIP.MEM[CHIP.I + 1] = (CHIP.V[X] / 10) % 10;
-      CHIP.MEM[CHIP.I + 2] = (CHIP.V[X] % 100) % 10;
-      DEBUG_PRINT(("Executed FX33\n"));
+      write_mem(chip, chip->I, chip->V[X] / 100);
+      write_mem(chip, chip->I + 1, (chip->V[X] / 10) % 10);
+      write_mem(chip, chip->I + 2, (chip->V[X] % 100) % 10);
+      break;
+    case 0x3A:
+      // FX3A: Set the audio pitch to the value of register VX (XO-CHIP)
+      chip->PITCH = chip->V[X];
       break;
     case 0x55:
       // FX55: Store the values of registers V0 to VX inclusive in memory
       //       starting at address I
       //       I is set to I + X + 1 after operation
       for (int i = 0; i <= X; i++) {
-        CHIP.MEM[CHIP.I + i] = CHIP.V[i];
+        write_mem(chip, chip->I + i, chip->V[i]);
       }
-      if (STR_LDR_LEGACY_BEHAVIOR) {
-        CHIP.I += CHIP.V[X] + 1;
+      if (chip->QUIRKS != QUIRKS_SCHIP) {
+        chip->I += X + 1;
       }
-      DEBUG_PRINT(("Executed FX55\n"));
       break;
     case 0x65:
       // FX65: Fill registers V0 to VX inclusive with the values stored in
       //       memory starting at address I
       //       I is set to I + X + 1 after operation
       for (int i = 0; i <= X; i++) {
-        CHIP.V[i] = CHIP.MEM[CHIP.I + i];
+        chip->V[i] = chip->MEM[(chip->I + i) & (MEM_SIZE - 1)];
+      }
+      if (chip->QUIRKS != QUIRKS_SCHIP) {
+        chip->I += X + 1;
       }
-      if (STR_LDR_LEGACY_BEHAVIOR) {
-        CHIP.I += CHIP.V[X] + 1;
+      break;
+    case 0x75:
+      // FX75: Store V0 to VX inclusive in the flag registers (SUPER-CHIP)
+      for (int i = 0; i <= X; i++) {
+        chip->FLAGS[i] = chip->V[i];
+      }
+      break;
+    case 0x85:
+      // FX85: Fill V0 to VX inclusive from the flag registers (SUPER-CHIP)
+      for (int i = 0; i <= X; i++) {
+        chip->V[i] = chip->FLAGS[i];
       }
-      DEBUG_PRINT(("Executed FX65\n"));
       break;
     }
     break;
@@ -374,31 +659,3 @@ void run_opcode() {
 #undef Y
 #undef NN
 #undef NNN
-
-#define PROGRAM KEYPAD_TEST
-int main() {
-  init_keyboard();
-  init_display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
-  init_chip();
-  load_program(PROGRAM, sizeof(PROGRAM));
-  unsigned int last_decrement = 0;
-  while (true) {
-    emulate_cycle();
-    set_keys(CHIP.KEYPAD);
-    unsigned int current_tick = timer_get_ticks();
-    if (current_tick - last_decrement >= 16666) {
-      if (CHIP.DELAY_TIMER > 0) {
-        CHIP.DELAY_TIMER--;
-      }
-      if (CHIP.SOUND_TIMER > 0) {
-        CHIP.SOUND_TIMER--;
-        play_sound(false);
-      } else {
-        play_sound(true);
-      }
-      last_decrement = current_tick;
-    }
-    // timer_delay_ms(12);
-  }
-  return 0;
-}
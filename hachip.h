@@ -2,15 +2,61 @@
 #define HACHIP_H
 #include <stdbool.h>
 #include <stddef.h>
+#include <stdint.h>
+
+#include "audio.h"
+#include "display.h"
+#include "opcodes.h"
+
+#define MEM_SIZE 4096
+// where programs are loaded and start running
+#define PROGRAM_START 0x200
+#define FONT_START 0x50
+// SUPER-CHIP 8x10 digits for FX30, right after the small font
+#define BIG_FONT_START 0xA0
+// random seed of a new chip; any non-zero value works
+#define DEFAULT_SEED 0x2545F491u
+
+typedef struct chip chip_t;
+
+// what a chip needs from the outside world; every call gets the chip, so one
+// set of callbacks can serve many machines (see chip_t.USER)
+typedef struct {
+  // shows the rows of chip->PIXELS flagged in dirty, see flush_display
+  void (*update_display)(chip_t *chip, uint64_t dirty);
+  // updates keypad with the keys pressed and released since the last call
+  void (*set_keys)(chip_t *chip, bool *keypad);
+  void (*play_sound)(chip_t *chip, bool on);
+} chip_io_t;
+
+// callbacks backed by peripherals.h and the system timer
+extern const chip_io_t PERIPHERALS_IO;
+
+// what aot_run knows about the ahead-of-time compiled program in memory, see
+// aot.h
+typedef struct {
+  // the program found for what is in memory, NULL if none; looked for again
+  // after every aot_reset
+  const struct aot_program *program;
+  bool looked_up;
+  // bytes of the compiled blocks still in use; write_mem reports writes to
+  // them to aot_invalidate
+  bool covered[MEM_SIZE];
+  // block starts whose code has been overwritten since
+  bool dead[MEM_SIZE];
+} aot_state_t;
 
 // https://tobiasvl.github.io/blog/write-a-chip-8-emulator/#stack
 // https://multigesture.net/articles/how-to-write-an-emulator-chip-8-interpreter/
-typedef struct {
+//
+// every function below takes the machine it works on, so any number of
+// chips can run side by side
+struct chip {
   unsigned short OPCODE;
   // 4 kilobytes of RAM
   // 0x000-0x1FF - interpreter & font
   // 0x200-0xFFF - program & RAM
-  unsigned char MEM[4096];
+  unsigned char MEM[MEM_SIZE];
   // 16 8-bit general-purpose variable registers
   // (V0 to VF)
   unsigned char V[16];
@@ -21,42 +67,123 @@ typedef struct {
   // 16 level stack
   unsigned short STACK[16];
   unsigned short SP;
-  // pixel states (64 * 32)
-  bool (*PIXELS)[64];
+  // pixel states per plane, ROW_WORDS words per row (see display.h); only
+  // the top-left 64x32 is used in lo-res
+  uint64_t PIXELS[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+  // rows changed since the last flush_display (bit y = row y)
+  uint64_t DIRTY;
+  // 128x64 mode (00FF) rather than 64x32 (00FE)
+  bool HIRES;
+  // planes drawn, cleared and scrolled (bit p = plane p), set by FN01
+  unsigned char PLANES;
   // hex keypad
   bool KEYPAD[16];
   // two timer registers that decrement at 60 Hz
   unsigned char DELAY_TIMER;
   unsigned char SOUND_TIMER;
-} chip_t;
-
-chip_t CHIP;
-
-void init_chip(void);
-
-void load_program(unsigned short *program, size_t size);
-
-void emulate_cycle(void);
-
-void run_opcode();
-
-unsigned char font[80] = {
-    0xF0, 0x90, 0x90, 0x90, 0xF0, // 0
-    0x20, 0x60, 0x20, 0x20, 0x70, // 1
-    0xF0, 0x10, 0xF0, 0x80, 0xF0, // 2
-    0xF0, 0x10, 0xF0, 0x10, 0xF0, // 3
-    0x90, 0x90, 0xF0, 0x10, 0x10, // 4
-    0xF0, 0x80, 0xF0, 0x10, 0xF0, // 5
-    0xF0, 0x80, 0xF0, 0x90, 0xF0, // 6
-    0xF0, 0x10, 0x20, 0x40, 0x40, // 7
-    0xF0, 0x90, 0xF0, 0x90, 0xF0, // 8
-    0xF0, 0x90, 0xF0, 0x10, 0xF0, // 9
-    0xF0, 0x90, 0xF0, 0x90, 0x90, // A
-    0xE0, 0x90, 0xE0, 0x90, 0xE0, // B
-    0xF0, 0x80, 0x80, 0x80, 0xF0, // C
-    0xE0, 0x90, 0x90, 0x90, 0xE0, // D
-    0xF0, 0x80, 0xF0, 0x80, 0xF0, // E
-    0xF0, 0x80, 0xF0, 0x80, 0x80  // F
+  // XO-CHIP audio pattern (F002) and pitch (FX3A) the buzzer plays, see
+  // audio.h
+  unsigned char AUDIO[AUDIO_PATTERN_SIZE];
+  unsigned char PITCH;
+  // persistent flag registers for FX75/FX85
+  unsigned char FLAGS[16];
+  // quirks_t the program was loaded with (see opcodes.h)
+  unsigned char QUIRKS;
+  // xorshift32 state behind CXNN, never 0; set with seed_random
+  uint32_t RNG;
+
+  // peripherals and a pointer left for their use
+  const chip_io_t *IO;
+  void *USER;
+
+  // caches derived from MEM, see predecode.h and aot.h
+  instr_t PREDECODED[MEM_SIZE];
+  aot_state_t COMPILED;
+
+  // blocks translated at run time, NULL when not translating; see jit.h
+  struct jit *TRANSLATED;
+
+  // ring to record instructions in, NULL when not tracing; see trace.h
+  struct trace *TRACE;
+
+#ifdef PROFILING
+  // counters to fill in, NULL when not profiling; see profile.h
+  struct profile *PROFILE;
+#endif
 };
 
+void init_chip(chip_t *chip, const chip_io_t *io);
+
+// copies a ROM image (the bytes of a .ch8 file) to PROGRAM_START and decodes
+// memory for the given quirk profile
+void load_program(chip_t *chip, const unsigned char *program, size_t size,
+                  quirks_t quirks);
+
+// restarts the random sequence CXNN draws from; runs with the same seed,
+// program and input execute identically
+void seed_random(chip_t *chip, uint32_t seed);
+
+static inline uint32_t next_random(chip_t *chip) {
+  uint32_t x = chip->RNG;
+  x ^= x << 13;
+  x ^= x >> 17;
+  x ^= x << 5;
+  return chip->RNG = x;
+}
+
+void emulate_cycle(chip_t *chip);
+
+// runs count instructions through the engine selected by DISPATCH
+void emulate_cycles(chip_t *chip, unsigned int count);
+
+// events emulate_until can stop on, as a mask, and why it stopped
+typedef enum {
+  // ran all the instructions asked for
+  STOP_COUNT = 0,
+  // after an instruction that drew, cleared, scrolled or switched mode
+  STOP_DISPLAY = 1 << 0,
+  // after an FX0A that found no key held; PC stays on it
+  STOP_KEY_WAIT = 1 << 1,
+  // after an FX18 that started the sound timer
+  STOP_SOUND = 1 << 2,
+  // before an instruction the interpreter does not implement (0NNN or an
+  // unknown opcode), which is not run; PC stays on it
+  STOP_INVALID = 1 << 3,
+  STOP_ALL = STOP_DISPLAY | STOP_KEY_WAIT | STOP_SOUND | STOP_INVALID
+} stop_t;
+
+// runs up to count instructions in one call, returning early at the first of
+// the events in stop_on; returns the instructions run and sets *reason to the
+// event, or to STOP_COUNT if there was none. lets an embedder present a
+// frame, wait for input or start audio as soon as the program asks for it
+unsigned int emulate_until(chip_t *chip, unsigned int count,
+                           unsigned int stop_on, stop_t *reason);
+
+void run_opcode(chip_t *chip);
+
+// decrements the delay and sound timers; called at 60 Hz
+void tick_timers(chip_t *chip);
+
+// hands the rows changed since the last call to the display; called once per
+// frame rather than from the drawing opcodes
+void flush_display(chip_t *chip);
+
+// display instruction bodies, shared by run_opcode and the dispatch engines;
+// all of them act on the planes selected in PLANES
+void clear_screen(chip_t *chip);
+
+// DXYN; a height of 0 draws a 16x16 sprite
+void draw_sprite(chip_t *chip, unsigned char vx, unsigned char vy, int height);
+
+// 00CN and 00DN
+void scroll_down(chip_t *chip, int rows);
+void scroll_up(chip_t *chip, int rows);
+
+// 00FB and 00FC, by 4 pixels
+void scroll_right(chip_t *chip);
+void scroll_left(chip_t *chip);
+
+// 00FE and 00FF; switching clears the display
+void set_hires(chip_t *chip, bool hires);
+
 #endif
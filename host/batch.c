@@ -0,0 +1,264 @@
+#include "hachip.h"
+#include "library.h"
+#include "roms.h"
+#include "scheduler.h"
+#include "stream.h"
+#include "timer.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// parallel batch runner: runs every selected ROM `repeats` times, each run a
+// separate chip with its own key script phase and random seed, spread over a
+// pool of worker threads; prints the final state of every run so sweeps can
+// be diffed between builds
+//
+// usage: batch [-j threads] [-f frames] [-r repeats] [-L dir]
+//              [-O unix:socket] [rom ...]
+//   -j  worker threads (default 4)
+//   -f  frames per run (default 10000)
+//   -r  runs per ROM (default 8)
+//   -L  run ROMs from the library in dir (library.h) instead of the built-in
+//       ones, picked by name or hash; they stay mapped, shared by every run
+//   -O  send the display of every run over its own connection to a Unix
+//       socket as a stream of changes (stream.h), for host/view to watch
+//   rom names from roms/catalog.txt (default: all of them)
+
+#define DEFAULT_THREADS 4
+#define DEFAULT_FRAMES 10000UL
+#define DEFAULT_REPEATS 8
+// as in bench, frames run back to back on a fixed instruction count
+#define INSTRUCTIONS_PER_FRAME 1000
+// set_keys calls each key mask is held for
+#define KEY_HOLD 4
+
+// one run; everything a worker touches lives here or in the chip, so jobs
+// share nothing but the read-only ROM images
+typedef struct {
+  const rom_t *rom;
+  int repeat;
+  unsigned long frames;
+  uint32_t seed;
+  // per-run peripherals, reached through chip_t.USER
+  unsigned long key_calls;
+  // display stream for -O, if it could be opened
+  stream_t stream;
+  bool streaming;
+  // results
+  unsigned short pc;
+  uint32_t display_hash;
+  double seconds;
+  unsigned long idle_instructions;
+} job_t;
+
+// presses each key in turn, starting at a different key for every repeat
+static void job_set_keys(chip_t *chip, bool *keypad) {
+  job_t *job = chip->USER;
+  unsigned long step = job->key_calls++ / KEY_HOLD + job->repeat * 2;
+  unsigned int key = (step / 2) % 16;
+  for (int i = 0; i < 16; i++) {
+    keypad[i] = step % 2 == 1 && i == key;
+  }
+}
+
+static void job_update_display(chip_t *chip, uint64_t dirty) {
+  // the final PIXELS are hashed once the run is over; only a stream shows
+  // the frames on the way
+  job_t *job = chip->USER;
+  if (job->streaming) {
+    stream_update(&job->stream,
+                  (const uint64_t(*)[HIRES_HEIGHT][ROW_WORDS])chip->PIXELS,
+                  chip->HIRES ? HIRES_WIDTH : DISPLAY_WIDTH,
+                  chip->HIRES ? HIRES_HEIGHT : DISPLAY_HEIGHT, dirty);
+  }
+}
+
+static void job_play_sound(chip_t *chip, bool on) {}
+
+static const chip_io_t JOB_IO = {
+    .update_display = job_update_display,
+    .set_keys = job_set_keys,
+    .play_sound = job_play_sound,
+};
+
+// FNV-1a over every plane, row by row
+static uint32_t hash_pixels(const chip_t *chip) {
+  const unsigned char *bytes = (const unsigned char *)chip->PIXELS;
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < sizeof(chip->PIXELS); i++) {
+    hash = (hash ^ bytes[i]) * 16777619u;
+  }
+  return hash;
+}
+
+static double now_seconds(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// where -O streams go, NULL for none
+static const char *stream_target;
+
+static void run_job(job_t *job) {
+  // chip_t carries its caches, too big for a worker stack
+  chip_t *chip = malloc(sizeof(chip_t));
+  if (chip == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+
+  // CPU time rather than wall time, so runs sharing a core are not
+  // counted twice in the speedup
+  double start = now_seconds(CLOCK_THREAD_CPUTIME_ID);
+  init_chip(chip, &JOB_IO);
+  chip->USER = job;
+  seed_random(chip, job->seed);
+  load_program(chip, job->rom->data, job->rom->size,
+               job->rom->quirks);
+  if (stream_target != NULL && stream_open(&job->stream, stream_target)) {
+    char name[STREAM_NAME_SIZE];
+    snprintf(name, sizeof(name), "%s#%d", job->rom->name, job->repeat);
+    stream_begin(&job->stream, name);
+    job->streaming = true;
+  }
+
+  scheduler_t sched;
+  scheduler_init(&sched, chip, INSTRUCTIONS_PER_FRAME);
+  sched.frame_ticks = 0;
+  // nothing is shown but the stream; the final PIXELS are hashed instead
+  sched.turbo = true;
+  sched.turbo_render = job->streaming ? 1 : 0;
+  while (sched.frames < job->frames) {
+    run_frame(&sched);
+  }
+  job->seconds = now_seconds(CLOCK_THREAD_CPUTIME_ID) - start;
+  job->idle_instructions = sched.idle_instructions;
+  if (job->streaming) {
+    stream_close(&job->stream);
+  }
+  job->pc = chip->PC;
+  job->display_hash = hash_pixels(chip);
+
+  free(chip);
+}
+
+static job_t *jobs;
+static int num_jobs;
+static int next_job;
+static pthread_mutex_t next_job_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void *worker(void *arg) {
+  for (;;) {
+    pthread_mutex_lock(&next_job_lock);
+    int i = next_job++;
+    pthread_mutex_unlock(&next_job_lock);
+    if (i >= num_jobs) {
+      return NULL;
+    }
+    run_job(&jobs[i]);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  int threads = DEFAULT_THREADS;
+  unsigned long frames = DEFAULT_FRAMES;
+  int repeats = DEFAULT_REPEATS;
+  const char *library_dir = NULL;
+  char **keys = calloc(argc, sizeof(char *));
+  int num_keys = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-j") == 0 && i + 1 < argc) {
+      threads = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      frames = strtoul(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc) {
+      repeats = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+      library_dir = argv[++i];
+    } else if (strcmp(argv[i], "-O") == 0 && i + 1 < argc) {
+      stream_target = argv[++i];
+      // every run opens the target for itself
+      if (strncmp(stream_target, "unix:", 5) != 0) {
+        fprintf(stderr, "batch streams need a unix:socket target\n");
+        return 1;
+      }
+    } else if (argv[i][0] != '-') {
+      keys[num_keys++] = argv[i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [-j threads] [-f frames] [-r repeats] [-L dir] "
+              "[-O unix:socket] [rom ...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  if (threads < 1) {
+    threads = 1;
+  }
+  if (repeats < 1) {
+    repeats = 1;
+  }
+
+  library_t library;
+  int num_roms;
+  rom_t *roms =
+      library_select(&library, library_dir, keys, num_keys, &num_roms);
+  if (roms == NULL) {
+    return 1;
+  }
+  jobs = calloc(num_roms * repeats + 1, sizeof(job_t));
+  pthread_t *pool = calloc(threads, sizeof(pthread_t));
+  if (jobs == NULL || pool == NULL) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  for (int i = 0; i < num_roms; i++) {
+    for (int r = 0; r < repeats; r++) {
+      job_t *job = &jobs[num_jobs++];
+      job->rom = &roms[i];
+      job->repeat = r;
+      job->frames = frames;
+      job->seed = r + 1;
+    }
+  }
+
+  // the first call to timer_get_ticks is not thread safe
+  timer_init();
+  double start = now_seconds(CLOCK_MONOTONIC);
+  for (int t = 0; t < threads; t++) {
+    if (pthread_create(&pool[t], NULL, worker, NULL) != 0) {
+      fprintf(stderr, "cannot start worker %d\n", t);
+      return 1;
+    }
+  }
+  for (int t = 0; t < threads; t++) {
+    pthread_join(pool[t], NULL);
+  }
+  double wall = now_seconds(CLOCK_MONOTONIC) - start;
+
+  printf("%-12s %6s %5s %10s %9s\n", "rom", "run", "pc", "display",
+         "cpu s");
+  double busy = 0;
+  double skipped = 0;
+  for (int i = 0; i < num_jobs; i++) {
+    printf("%-12s %6d %5.3x %10.8x %9.3f\n", jobs[i].rom->name, jobs[i].repeat,
+           jobs[i].pc, jobs[i].display_hash, jobs[i].seconds);
+    busy += jobs[i].seconds;
+    skipped += jobs[i].idle_instructions;
+  }
+  // only the instructions run count, not those skipped in idle loops
+  double instructions =
+      (double)num_jobs * frames * INSTRUCTIONS_PER_FRAME - skipped;
+  printf("%d runs on %d threads: %.0f instructions (%.0f skipped idle) in "
+         "%.3f s, %.0f instr/sec, %.2fx speedup\n",
+         num_jobs, threads, instructions, skipped, wall, instructions / wall,
+         busy / wall);
+
+  free(pool);
+  free(jobs);
+  return 0;
+}
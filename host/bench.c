@@ -0,0 +1,517 @@
+#include "aot.h"
+#include "dispatch.h"
+#include "hachip.h"
+#include "headless.h"
+#include "jit.h"
+#include "library.h"
+#include "peripherals.h"
+#include "predecode.h"
+#include "profile.h"
+#include "replay.h"
+#include "rewind.h"
+#include "roms.h"
+#include "scheduler.h"
+#include "snapshot.h"
+#include "timer.h"
+#include "trace.h"
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// throughput benchmark: runs each built-in ROM for a fixed number of
+// instructions on the headless backend and reports instructions/sec
+//
+// usage: bench [-n instructions] [-e engine] [-V] [-R] [-P table|csv] [-t]
+//              [-d] [-S] [-T frames] [-I log] [-A file] [-L dir]
+//              [-O target] [rom ...]
+//   -n  instructions per ROM (default 10000000)
+//   -e  dispatch engine: switch, table, until, aot, jit or threaded
+//       (default: DISPATCH)
+//   -V  verify the engine against run_opcode after every frame
+//   -R  record every frame into a rewind buffer, then step back through it
+//       and check each frame against a full snapshot taken at the time
+//   -P  run through the profiler instead of the engine and print its
+//       counters as tables or as comma-separated values
+//   -t  run through the tracer instead of the engine and print the trace of
+//       the last instructions (trace.h), for host/tracedump
+//   -d  dump the final display of each ROM
+//   -S  spin through idle loops instead of skipping them, to time the engine
+//       on every instruction
+//   -T  turbo mode, showing every given number of frames (0: none); the
+//       display is only drawn for those
+//   -I  replay an input log (replay.h) instead: runs its ROM for its frames
+//       with its seed, instructions per frame and keys
+//   -A  write the sound of the ROMs run to file, a frame of sound per frame
+//       run, as 8-bit WAV or as raw samples if the name ends in .raw
+//   -L  run ROMs from the library in dir (library.h) instead of the built-in
+//       ones, picked by name or hash
+//   -O  send the display of the ROMs run to target, a file, FIFO or
+//       unix:socket, as a stream of changes (stream.h) for host/view
+//   rom names from roms/catalog.txt (default: all of them)
+
+#define DEFAULT_INSTRUCTIONS 10000000UL
+// frames run back to back (no waiting for the 60 Hz boundary), so timers and
+// keys are serviced on a fixed instruction count and every run executes the
+// same workload
+#define INSTRUCTIONS_PER_FRAME 1000
+
+typedef struct {
+  const char *name;
+  void (*run)(chip_t *chip, unsigned int count);
+} engine_t;
+
+// early exits of the until engine by reason, bit number of stop_t
+static unsigned long stops[4];
+
+// drives emulate_until the way an embedder would, stopping on every event
+// and carrying on; an invalid instruction is stepped over as a no-op
+static void until_run(chip_t *chip, unsigned int count) {
+  while (count > 0) {
+    stop_t reason;
+    count -= emulate_until(chip, count, STOP_ALL, &reason);
+    for (int bit = 0; bit < 4; bit++) {
+      if (reason & (1 << bit)) {
+        stops[bit]++;
+      }
+    }
+    if (reason == STOP_INVALID) {
+      dispatch_table(chip, 1);
+      count--;
+    }
+  }
+}
+
+static const engine_t engines[] = {
+    {"default", emulate_cycles},
+    {"switch", dispatch_switch},
+    {"table", dispatch_table},
+    {"until", until_run},
+    {"aot", aot_run},
+    {"jit", jit_run},
+#ifdef __GNUC__
+    {"threaded", dispatch_threaded},
+#endif
+};
+#define NUM_ENGINES (sizeof(engines) / sizeof(engines[0]))
+
+// press each key in turn with a release in between so FX0A waits complete
+static const unsigned short key_script[] = {
+    0x0000, 0x0001, 0x0000, 0x0002, 0x0000, 0x0004, 0x0000, 0x0008,
+    0x0000, 0x0010, 0x0000, 0x0020, 0x0000, 0x0040, 0x0000, 0x0080,
+    0x0000, 0x0100, 0x0000, 0x0200, 0x0000, 0x0400, 0x0000, 0x0800,
+    0x0000, 0x1000, 0x0000, 0x2000, 0x0000, 0x4000, 0x0000, 0x8000,
+};
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const engine_t *verify_engine;
+static unsigned long verify_done;
+static bool verify_failed;
+
+// runs a frame's batch with verify_engine and again with the reference switch
+// from the same starting state, and reports any difference
+static void verify_run(chip_t *chip, unsigned int count) {
+  // chip_t carries its caches, too big for the stack
+  static chip_t before, after;
+  before = *chip;
+
+  verify_engine->run(chip, count);
+  after = *chip;
+
+  *chip = before;
+  predecode_all(chip);
+  aot_reset(chip);
+  dispatch_switch(chip, count);
+
+  const char *diff = NULL;
+  if (memcmp(after.MEM, chip->MEM, sizeof(chip->MEM)) != 0) {
+    diff = "MEM";
+  } else if (memcmp(after.V, chip->V, sizeof(chip->V)) != 0) {
+    diff = "V";
+  } else if (after.I != chip->I || after.PC != chip->PC ||
+             after.SP != chip->SP) {
+    diff = "I/PC/SP";
+  } else if (memcmp(after.STACK, chip->STACK, sizeof(chip->STACK)) != 0) {
+    diff = "STACK";
+  } else if (after.DELAY_TIMER != chip->DELAY_TIMER ||
+             after.SOUND_TIMER != chip->SOUND_TIMER) {
+    diff = "timers";
+  } else if (memcmp(after.PIXELS, chip->PIXELS, sizeof(chip->PIXELS)) != 0 ||
+             after.HIRES != chip->HIRES || after.PLANES != chip->PLANES) {
+    diff = "display";
+  } else if (memcmp(after.FLAGS, chip->FLAGS, sizeof(chip->FLAGS)) != 0) {
+    diff = "FLAGS";
+  } else if (memcmp(after.AUDIO, chip->AUDIO, sizeof(chip->AUDIO)) != 0 ||
+             after.PITCH != chip->PITCH) {
+    diff = "audio";
+  }
+  if (diff != NULL && !verify_failed) {
+    printf("verify: %s differs from run_opcode in the frame after %lu "
+           "instructions (PC %03x vs %03x)\n",
+           diff, verify_done, after.PC, chip->PC);
+    verify_failed = true;
+  }
+  verify_done += count;
+}
+
+static chip_t chip;
+// blocks for the jit engine, in memory mapped executable by map_code
+static jit_t jit;
+
+typedef enum { PROFILE_OFF, PROFILE_TABLE, PROFILE_CSV } profile_mode_t;
+
+static profile_t profile;
+static trace_t trace;
+// sound sink for -A; with several ROMs each one overwrites the last
+static FILE *audio_out;
+static bool audio_raw;
+// display stream for -O; each ROM run starts a new run in it
+static stream_t display_stream;
+static bool streaming;
+
+static rewind_t history;
+// the newest REWIND_MAX_FRAMES frames in full, indexed by frame % size
+static snapshot_t expected[REWIND_MAX_FRAMES];
+
+// steps back through everything in history and reports how many frames came
+// back identical to what was recorded
+static void check_rewind(unsigned long frames, double push_seconds) {
+  unsigned int held = rewind_frames(&history);
+  unsigned long kb = rewind_words_used(&history) * sizeof(uint32_t) / 1024;
+  unsigned int steps = 0;
+  snapshot_t restored;
+  while (rewind_step(&history, &chip)) {
+    steps++;
+    snapshot_save(&chip, &restored);
+    unsigned long frame = frames - 1 - steps;
+    if (memcmp(&restored, &expected[frame % REWIND_MAX_FRAMES],
+               sizeof(restored)) != 0) {
+      printf("rewind: frame %u back differs from the recording\n", steps);
+      return;
+    }
+  }
+  printf("rewind: %u frames in %lu KB, %.2f us/push, %u steps back checked\n",
+         held, kb, push_seconds * 1e6 / frames, steps);
+}
+
+static replay_t replay;
+
+// size bytes of zeroed memory that can be written and executed, NULL if the
+// system refuses; mapped from /dev/zero as MAP_ANONYMOUS is not POSIX
+static unsigned char *map_code(size_t size) {
+  int fd = open("/dev/zero", O_RDWR);
+  if (fd < 0) {
+    return NULL;
+  }
+  void *code = mmap(NULL, size, PROT_READ | PROT_WRITE | PROT_EXEC,
+                    MAP_PRIVATE, fd, 0);
+  close(fd);
+  return code != MAP_FAILED ? code : NULL;
+}
+
+// reads a log written by replay_print; returns false if it is malformed
+static bool load_replay(const char *path, replay_t *log) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    return false;
+  }
+  int version, quirks;
+  char rom[REPLAY_NAME_SIZE];
+  unsigned int seed, instructions_per_frame, frames;
+  bool ok = fscanf(in, " replay %d %31s %d %x %u %u", &version, rom, &quirks,
+                   &seed, &instructions_per_frame, &frames) == 6 &&
+            version == REPLAY_VERSION && quirks >= 0 && quirks < NUM_QUIRKS;
+  if (ok) {
+    replay_init(log, rom, quirks, seed, instructions_per_frame);
+    unsigned int frame, keys;
+    while (ok && fscanf(in, " %u %x", &frame, &keys) == 2) {
+      ok = log->count < REPLAY_MAX_EVENTS && frame < frames;
+      if (ok) {
+        log->events[log->count].frame = frame;
+        log->events[log->count].keys = keys;
+        log->count++;
+      }
+    }
+    char end[4];
+    ok = ok && fscanf(in, " %3s", end) == 1 && strcmp(end, "end") == 0;
+    log->frames = frames;
+    replay_restart(log);
+  }
+  fclose(in);
+  return ok;
+}
+
+// with replay set, the ROM runs for the logged frames instead of the
+// instruction count
+static void run_rom(const rom_t *rom, const engine_t *engine,
+                    unsigned long instructions, bool verify, bool record,
+                    profile_mode_t profiling, bool tracing, bool dump,
+                    bool spin, int turbo, replay_t *replay) {
+  init_keyboard();
+  init_display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+  unsigned long stream_records = display_stream.records;
+  unsigned long stream_bytes = display_stream.bytes;
+  if (streaming) {
+    stream_begin(&display_stream, rom->name);
+    headless_set_stream(&display_stream);
+  }
+  init_audio();
+  if (audio_out != NULL) {
+    headless_open_audio(audio_out, !audio_raw);
+  }
+  headless_set_key_script(key_script,
+                          sizeof(key_script) / sizeof(key_script[0]), 4);
+  init_chip(&chip, &PERIPHERALS_IO);
+  if (engine->run == jit_run) {
+    chip.TRANSLATED = &jit;
+  }
+  unsigned int instructions_per_frame = INSTRUCTIONS_PER_FRAME;
+  quirks_t quirks = rom->quirks;
+  if (replay != NULL) {
+    seed_random(&chip, replay->seed);
+    instructions_per_frame = replay->instructions_per_frame;
+    quirks = replay->quirks;
+    instructions = (unsigned long)replay->frames * instructions_per_frame;
+    replay_restart(replay);
+  }
+  load_program(&chip, rom->data, rom->size, quirks);
+
+  scheduler_t sched;
+  scheduler_init(&sched, &chip, instructions_per_frame);
+  sched.frame_ticks = 0;
+  sched.skip_idle = !spin;
+  if (turbo >= 0) {
+    sched.turbo = true;
+    sched.turbo_render = turbo;
+  }
+  sched.replay = replay;
+  sched.run = engine->run;
+  memset(stops, 0, sizeof(stops));
+  if (verify) {
+    verify_engine = engine;
+    verify_done = 0;
+    verify_failed = false;
+    sched.run = verify_run;
+  }
+  if (profiling != PROFILE_OFF) {
+    profile_reset(&profile);
+    chip.PROFILE = &profile;
+    sched.run = profile_run;
+  } else if (tracing) {
+    trace_reset(&trace);
+    chip.TRACE = &trace;
+    sched.run = trace_run;
+  }
+
+  rewind_init(&history);
+  double push_seconds = 0;
+
+  double start = now_seconds();
+  unsigned long frames = instructions / instructions_per_frame;
+  while (sched.frames < frames && !verify_failed) {
+    run_frame(&sched);
+    if (audio_out != NULL) {
+      fill_audio();
+    }
+    if (record) {
+      double push_start = now_seconds();
+      rewind_push(&history, &chip);
+      push_seconds += now_seconds() - push_start;
+      snapshot_save(&chip,
+                    &expected[(sched.frames - 1) % REWIND_MAX_FRAMES]);
+    }
+  }
+  double elapsed = now_seconds() - start;
+  if (sched.turbo) {
+    // show the final frame, which turbo may have skipped
+    flush_display(&chip);
+  }
+
+  // rates are over the instructions actually run; the skipped ones cost
+  // nothing and would make any engine look fast
+  unsigned long run = instructions - sched.idle_instructions;
+  printf("%-12s %12lu %9.3f %14.0f %9.2f %12lu %12lu\n", rom->name,
+         instructions, elapsed, run / elapsed,
+         run != 0 ? elapsed * 1e9 / run : 0.0, sched.idle_instructions,
+         headless_rows_drawn());
+  // -V runs the engine inside verify_run; -P and -t run theirs instead
+  if (engine->run == until_run && profiling == PROFILE_OFF && !tracing) {
+    printf("stops: %lu display, %lu key wait, %lu sound, %lu invalid\n",
+           stops[0], stops[1], stops[2], stops[3]);
+  }
+  if (engine->run == jit_run && profiling == PROFILE_OFF && !tracing) {
+    printf("jit: %lu blocks translated, dropped %lu times\n", jit.translated,
+           jit.flushes);
+  }
+  if (replay != NULL) {
+    printf("replay: %lu frames, %u key events, final PC %03x\n", frames,
+           (unsigned int)replay->count, chip.PC);
+  }
+  if (record) {
+    check_rewind(sched.frames, push_seconds);
+  }
+  if (audio_out != NULL) {
+    unsigned long samples = headless_close_audio();
+    printf("audio: %lu samples, %lu underruns\n", samples,
+           audio_underruns());
+  }
+  if (streaming) {
+    printf("stream: %lu records, %lu bytes\n",
+           display_stream.records - stream_records,
+           display_stream.bytes - stream_bytes);
+  }
+  if (profiling == PROFILE_TABLE) {
+    profile_print(&profile);
+  } else if (profiling == PROFILE_CSV) {
+    profile_print_csv(&profile);
+  }
+  if (chip.TRACE != NULL) {
+    trace_dump(&chip);
+  }
+  if (dump) {
+    headless_dump_display(stdout);
+  }
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long instructions = DEFAULT_INSTRUCTIONS;
+  const engine_t *engine = &engines[0];
+  bool verify = false;
+  bool record = false;
+  profile_mode_t profiling = PROFILE_OFF;
+  bool tracing = false;
+  bool dump = false;
+  bool spin = false;
+  int turbo = -1;
+  const char *replay_path = NULL;
+  const char *audio_path = NULL;
+  const char *library_dir = NULL;
+  const char *stream_target = NULL;
+  char **keys = calloc(argc, sizeof(char *));
+  int num_keys = 0;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+      instructions = strtoul(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "-e") == 0 && i + 1 < argc) {
+      engine = NULL;
+      i++;
+      for (int j = 0; j < NUM_ENGINES; j++) {
+        if (strcmp(argv[i], engines[j].name) == 0) {
+          engine = &engines[j];
+        }
+      }
+      if (engine == NULL) {
+        fprintf(stderr, "unknown engine %s\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-V") == 0) {
+      verify = true;
+    } else if (strcmp(argv[i], "-R") == 0) {
+      record = true;
+    } else if (strcmp(argv[i], "-P") == 0 && i + 1 < argc) {
+      i++;
+      if (strcmp(argv[i], "table") == 0) {
+        profiling = PROFILE_TABLE;
+      } else if (strcmp(argv[i], "csv") == 0) {
+        profiling = PROFILE_CSV;
+      } else {
+        fprintf(stderr, "unknown profile format %s\n", argv[i]);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-t") == 0) {
+      tracing = true;
+    } else if (strcmp(argv[i], "-d") == 0) {
+      dump = true;
+    } else if (strcmp(argv[i], "-S") == 0) {
+      spin = true;
+    } else if (strcmp(argv[i], "-T") == 0 && i + 1 < argc) {
+      turbo = atoi(argv[++i]);
+    } else if (strcmp(argv[i], "-I") == 0 && i + 1 < argc) {
+      replay_path = argv[++i];
+    } else if (strcmp(argv[i], "-A") == 0 && i + 1 < argc) {
+      audio_path = argv[++i];
+    } else if (strcmp(argv[i], "-L") == 0 && i + 1 < argc) {
+      library_dir = argv[++i];
+    } else if (strcmp(argv[i], "-O") == 0 && i + 1 < argc) {
+      stream_target = argv[++i];
+    } else if (argv[i][0] != '-') {
+      keys[num_keys++] = argv[i];
+    } else {
+      fprintf(stderr,
+              "usage: %s [-n instructions] [-e engine] [-V] [-R] "
+              "[-P table|csv] [-t] [-d] [-S] [-T frames] [-I log] "
+              "[-A file] [-L dir] [-O target] [rom ...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  // round up to whole frames so every ROM runs the same count
+  instructions = (instructions + INSTRUCTIONS_PER_FRAME - 1) /
+                 INSTRUCTIONS_PER_FRAME * INSTRUCTIONS_PER_FRAME;
+
+  if (replay_path != NULL) {
+    if (!load_replay(replay_path, &replay)) {
+      fprintf(stderr, "%s is not a valid input log\n", replay_path);
+      return 1;
+    }
+    // the log names its ROM
+    keys[0] = replay.rom;
+    num_keys = 1;
+  }
+  if (engine->run == jit_run) {
+    unsigned char *code = map_code(JIT_CODE_SIZE);
+    if (code == NULL) {
+      perror("jit code");
+      return 1;
+    }
+    jit_init(&jit, code, JIT_CODE_SIZE);
+  }
+  library_t library;
+  int num_roms;
+  rom_t *roms =
+      library_select(&library, library_dir, keys, num_keys, &num_roms);
+  if (roms == NULL) {
+    return 1;
+  }
+
+  if (audio_path != NULL) {
+    size_t length = strlen(audio_path);
+    audio_raw = length >= 4 && strcmp(audio_path + length - 4, ".raw") == 0;
+    audio_out = fopen(audio_path, "wb");
+    if (audio_out == NULL) {
+      perror(audio_path);
+      return 1;
+    }
+  }
+
+  if (stream_target != NULL) {
+    if (!stream_open(&display_stream, stream_target)) {
+      return 1;
+    }
+    streaming = true;
+  }
+
+  // line buffered so a trace printed by a failing TRACE_ASSERT is not lost
+  // with the buffer when the process aborts
+  setvbuf(stdout, NULL, _IOLBF, 0);
+  timer_init();
+  printf("engine: %s\n", profiling != PROFILE_OFF ? "profile"
+                         : tracing                 ? "trace"
+                                                   : engine->name);
+  printf("%-12s %12s %9s %14s %9s %12s %12s\n", "rom", "instructions",
+         "seconds", "instr/sec", "ns/instr", "idle skipped", "rows drawn");
+  for (int i = 0; i < num_roms; i++) {
+    run_rom(&roms[i], engine, instructions, verify, record, profiling,
+            tracing, dump, spin, turbo, replay_path != NULL ? &replay : NULL);
+  }
+  return 0;
+}
@@ -0,0 +1,32 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+// extra controls for the headless peripherals backend used by host builds
+
+#include "stream.h"
+#include <stdbool.h>
+#include <stdio.h>
+
+// keys is a list of 16-bit keypad masks (bit i = key i held); each mask is
+// held for `hold` calls to set_keys before moving on, wrapping at the end
+void headless_set_key_script(const unsigned short *keys, int count, int hold);
+
+// writes everything played from now on to out, as 8-bit unsigned mono
+// samples at AUDIO_SAMPLE_RATE, behind a WAV header if wav is set (out must
+// then be seekable); fill_audio plays one frame of sound per call
+void headless_open_audio(FILE *out, bool wav);
+
+// stops writing and fixes up the WAV header; returns the samples written
+unsigned long headless_close_audio(void);
+
+// sends every display update from now on to stream as well (stream.h), or
+// stops with NULL
+void headless_set_stream(stream_t *stream);
+
+// rows redrawn and update_display calls since init_display
+unsigned long headless_rows_drawn(void);
+unsigned long headless_frames(void);
+
+// prints the recorded display as text, one line per row
+void headless_dump_display(FILE *out);
+
+#endif
@@ -0,0 +1,554 @@
+#include "library.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define MAX_ROM_SIZE (MEM_SIZE - PROGRAM_START)
+// the directory, a file name in it and its extension
+#define MAX_PATH (LIBRARY_DIR_SIZE + LIBRARY_NAME_SIZE + 16)
+
+static const char *const quirk_names[NUM_QUIRKS] = {"chip8", "schip",
+                                                    "xochip"};
+
+static uint64_t hash_bytes(const unsigned char *data, size_t size) {
+  // FNV-1a, 64 bits so thousands of ROMs stay far from a collision
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < size; i++) {
+    hash = (hash ^ data[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+static long long mtime_ns(const struct stat *st) {
+  return st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+// mtime of path in nanoseconds, 0 if it does not exist
+static long long path_mtime(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 ? mtime_ns(&st) : 0;
+}
+
+static int parse_quirks(const char *name) {
+  for (int q = 0; q < NUM_QUIRKS; q++) {
+    if (strcmp(name, quirk_names[q]) == 0) {
+      return q;
+    }
+  }
+  return -1;
+}
+
+// the platform a ROM was written for, from the instructions it uses.
+// sprites and other data can look like anything, so only instructions
+// reachable from PROGRAM_START by following jumps, calls and skips are
+// looked at; computed jumps (BNNN) are not followed, so this is a guess
+static quirks_t detect_quirks(const unsigned char *data, size_t size) {
+  bool seen[MEM_SIZE] = {false};
+  unsigned short pending[MEM_SIZE];
+  int num_pending = 0;
+  pending[num_pending++] = PROGRAM_START;
+  bool schip = false;
+  while (num_pending > 0) {
+    unsigned int pc = pending[--num_pending];
+    for (;;) {
+      unsigned int at = pc - PROGRAM_START;
+      if (pc < PROGRAM_START || pc + 1 >= MEM_SIZE || at + 1 >= size ||
+          seen[pc]) {
+        break;
+      }
+      seen[pc] = true;
+      unsigned int op = data[at] << 8 | data[at + 1];
+      unsigned int nnn = op & 0xFFF, kk = op & 0xFF, n = op & 0xF;
+      // XO-CHIP: F000 NNNN, plane, audio, pitch, scroll up, save/load range
+      if (op == 0xF000 || op == 0xF002 || (op & 0xF0FF) == 0xF03A ||
+          ((op & 0xF0FF) == 0xF001 && op != 0xF001) ||
+          (op & 0xFFF0) == 0x00D0 ||
+          ((op & 0xF000) == 0x5000 && (n == 2 || n == 3))) {
+        return QUIRKS_XOCHIP;
+      }
+      // SUPER-CHIP: scrolls, exit, resolution, 16x16 sprites, big font, flags
+      schip |= ((op & 0xFFF0) == 0x00C0 && n != 0) ||
+               (nnn >= 0x0FB && nnn <= 0x0FF && op >> 12 == 0) ||
+               ((op & 0xF000) == 0xD000 && n == 0) ||
+               ((op & 0xF000) == 0xF000 &&
+                (kk == 0x30 || kk == 0x75 || kk == 0x85));
+      if (op == 0x00EE || op == 0x00FD || op >> 12 == 0xB) {
+        break;
+      }
+      if (op >> 12 == 0x1) {
+        pc = nnn;
+        continue;
+      }
+      if (op >> 12 == 0x2 && num_pending < MEM_SIZE) {
+        pending[num_pending++] = nnn;
+      }
+      bool conditional = op >> 12 == 0x3 || op >> 12 == 0x4 ||
+                         ((op >> 12 == 0x5 || op >> 12 == 0x9) && n == 0) ||
+                         ((op & 0xF000) == 0xE000 &&
+                          (kk == 0x9E || kk == 0xA1));
+      if (conditional && num_pending < MEM_SIZE) {
+        pending[num_pending++] = pc + 4;
+      }
+      pc += 2;
+    }
+  }
+  return schip ? QUIRKS_SCHIP : QUIRKS_CHIP8;
+}
+
+static int compare_entries(const void *a, const void *b) {
+  return strcmp(((const library_entry_t *)a)->name,
+                ((const library_entry_t *)b)->name);
+}
+
+static library_entry_t *find_name(library_entry_t *entries, int count,
+                                  const char *name) {
+  if (count == 0) {
+    return NULL;
+  }
+  library_entry_t key;
+  snprintf(key.name, sizeof(key.name), "%s", name);
+  return bsearch(&key, entries, count, sizeof(library_entry_t),
+                 compare_entries);
+}
+
+// reads the index into *entries, sorted as written; false if it is missing
+// or not whole. the mtimes it was written for go to *dir_mtime and
+// *catalog_mtime
+static bool read_index(const char *path, library_entry_t **entries,
+                       int *count, long long *dir_mtime,
+                       long long *catalog_mtime) {
+  FILE *in = fopen(path, "r");
+  if (in == NULL) {
+    return false;
+  }
+  int version, expected;
+  if (fscanf(in, "hachip-index %d %lld %lld %d\n", &version, dir_mtime,
+             catalog_mtime, &expected) != 4 ||
+      version != LIBRARY_INDEX_VERSION || expected < 0) {
+    fclose(in);
+    return false;
+  }
+  *entries = calloc(expected > 0 ? expected : 1, sizeof(library_entry_t));
+  *count = 0;
+  char line[LIBRARY_NAME_SIZE + 128];
+  while (*entries != NULL && *count < expected &&
+         fgets(line, sizeof(line), in) != NULL) {
+    library_entry_t *entry = &(*entries)[*count];
+    unsigned long long hash;
+    char quirks[16];
+    int offset;
+    if (sscanf(line, "%16llx %u %lld %15s %n", &hash, &entry->size,
+               &entry->mtime, quirks, &offset) != 4 ||
+        parse_quirks(quirks) < 0) {
+      break;
+    }
+    line[strcspn(line, "\n")] = '\0';
+    snprintf(entry->name, sizeof(entry->name), "%s", line + offset);
+    entry->hash = hash;
+    entry->quirks = parse_quirks(quirks);
+    ++*count;
+  }
+  fclose(in);
+  // a write cut short leaves fewer entries than the header promises
+  if (*count != expected) {
+    free(*entries);
+    *entries = NULL;
+    return false;
+  }
+  return true;
+}
+
+// writes the index over path. it is rewritten in place rather than renamed
+// over, since a rename would change the directory mtime it records
+static void write_index(const library_t *lib, const char *path,
+                        long long dir_mtime, long long catalog_mtime) {
+  FILE *out = fopen(path, "w");
+  if (out == NULL) {
+    // a read-only library still works, only rescanned every time
+    perror(path);
+    return;
+  }
+  fprintf(out, "hachip-index %d %lld %lld %d\n", LIBRARY_INDEX_VERSION,
+          dir_mtime, catalog_mtime, lib->count);
+  for (int i = 0; i < lib->count; i++) {
+    const library_entry_t *entry = &lib->entries[i];
+    fprintf(out, "%016llx %u %lld %s %s\n", (unsigned long long)entry->hash,
+            entry->size, entry->mtime, quirk_names[entry->quirks],
+            entry->name);
+  }
+  fclose(out);
+}
+
+static int compare_catalog(const void *a, const void *b) {
+  return strcmp(((const library_catalog_entry_t *)a)->name,
+                ((const library_catalog_entry_t *)b)->name);
+}
+
+// reads catalog.txt in the library's directory into lib->catalog; a library
+// without one, or out of memory for it, gets its quirks guessed
+static void read_catalog(library_t *lib) {
+  lib->catalog_read = true;
+  char path[MAX_PATH];
+  snprintf(path, sizeof(path), "%s/catalog.txt", lib->dir);
+  FILE *list = fopen(path, "r");
+  if (list == NULL) {
+    return;
+  }
+  int capacity = 0;
+  char line[256];
+  while (fgets(line, sizeof(line), list) != NULL) {
+    char file[128], platform[16];
+    char *hash = strchr(line, '#');
+    if (hash != NULL) {
+      *hash = '\0';
+    }
+    size_t length;
+    int quirks;
+    if (sscanf(line, "%127s %15s", file, platform) != 2 ||
+        (length = strlen(file)) <= 4 ||
+        strcmp(file + length - 4, ".ch8") != 0 ||
+        (quirks = parse_quirks(platform)) < 0) {
+      continue;
+    }
+    if (lib->catalog_count == capacity) {
+      capacity = capacity * 2 + 64;
+      library_catalog_entry_t *grown = realloc(
+          lib->catalog, capacity * sizeof(library_catalog_entry_t));
+      if (grown == NULL) {
+        break;
+      }
+      lib->catalog = grown;
+    }
+    library_catalog_entry_t *entry = &lib->catalog[lib->catalog_count++];
+    snprintf(entry->name, sizeof(entry->name), "%.*s", (int)(length - 4),
+             file);
+    entry->quirks = quirks;
+  }
+  fclose(list);
+  qsort(lib->catalog, lib->catalog_count, sizeof(library_catalog_entry_t),
+        compare_catalog);
+}
+
+// the quirks catalog.txt in the library's directory gives for name, or -1
+static int catalog_quirks(library_t *lib, const char *name) {
+  if (!lib->catalog_read) {
+    read_catalog(lib);
+  }
+  if (lib->catalog_count == 0) {
+    return -1;
+  }
+  library_catalog_entry_t key;
+  snprintf(key.name, sizeof(key.name), "%s", name);
+  const library_catalog_entry_t *found =
+      bsearch(&key, lib->catalog, lib->catalog_count,
+              sizeof(library_catalog_entry_t), compare_catalog);
+  return found != NULL ? (int)found->quirks : -1;
+}
+
+// maps path read-only; NULL if it cannot be opened or is empty
+static const unsigned char *map_file(const char *path, struct stat *st) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  void *data = MAP_FAILED;
+  if (fstat(fd, st) == 0 && S_ISREG(st->st_mode) && st->st_size > 0) {
+    data = mmap(NULL, st->st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  // the mapping outlives the descriptor
+  close(fd);
+  return data == MAP_FAILED ? NULL : data;
+}
+
+// fills in the entry named entry->name for its file, mapped at data with
+// the status st
+static void index_file(library_t *lib, library_entry_t *entry,
+                       const unsigned char *data, const struct stat *st) {
+  entry->size = st->st_size;
+  entry->mtime = mtime_ns(st);
+  entry->hash = hash_bytes(data, st->st_size);
+  int quirks = catalog_quirks(lib, entry->name);
+  entry->quirks = quirks >= 0 ? quirks : detect_quirks(data, st->st_size);
+}
+
+static void print_too_big(const char *path, long long size) {
+  fprintf(stderr, "%s: %lld bytes, does not fit in the %d from 0x%x\n", path,
+          size, MAX_ROM_SIZE, PROGRAM_START);
+}
+
+static bool add_entry(library_t *lib, int *capacity, const char *name,
+                      const library_entry_t *old, bool catalog_changed) {
+  char path[MAX_PATH];
+  snprintf(path, sizeof(path), "%s/%s.ch8", lib->dir, name);
+  struct stat st;
+  if (stat(path, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size == 0) {
+    return true;
+  }
+  // no program that big can be loaded, so it is not read or indexed
+  if (st.st_size > MAX_ROM_SIZE) {
+    print_too_big(path, st.st_size);
+    return true;
+  }
+  if (lib->count == *capacity) {
+    *capacity = *capacity * 2 + 64;
+    library_entry_t *grown =
+        realloc(lib->entries, *capacity * sizeof(library_entry_t));
+    if (grown == NULL) {
+      return false;
+    }
+    lib->entries = grown;
+  }
+  library_entry_t *entry = &lib->entries[lib->count];
+  // unchanged since indexed: no need to read it
+  if (old != NULL && old->size == st.st_size && old->mtime == mtime_ns(&st) &&
+      !catalog_changed) {
+    *entry = *old;
+    lib->count++;
+    return true;
+  }
+  const unsigned char *data = map_file(path, &st);
+  if (data == NULL) {
+    return true;
+  }
+  snprintf(entry->name, sizeof(entry->name), "%s", name);
+  index_file(lib, entry, data, &st);
+  munmap((void *)data, st.st_size);
+  lib->count++;
+  lib->scanned++;
+  return true;
+}
+
+bool library_open(library_t *lib, const char *dir) {
+  memset(lib, 0, sizeof(*lib));
+  snprintf(lib->dir, sizeof(lib->dir), "%s", dir);
+  char index_path[MAX_PATH], catalog_path[MAX_PATH];
+  snprintf(index_path, sizeof(index_path), "%s/" LIBRARY_INDEX, lib->dir);
+  snprintf(catalog_path, sizeof(catalog_path), "%s/catalog.txt", lib->dir);
+
+  long long dir_mtime = path_mtime(dir);
+  long long catalog_mtime = path_mtime(catalog_path);
+  library_entry_t *old = NULL;
+  int old_count = 0;
+  long long index_dir_mtime = 0, index_catalog_mtime = 0;
+  bool indexed = read_index(index_path, &old, &old_count, &index_dir_mtime,
+                            &index_catalog_mtime);
+  // adding, removing or renaming a file changes the directory's mtime, so
+  // while it and the catalog's are as indexed the index is the listing
+  if (indexed && dir_mtime != 0 && index_dir_mtime == dir_mtime &&
+      index_catalog_mtime == catalog_mtime) {
+    lib->entries = old;
+    lib->count = old_count;
+    lib->dir_mtime = dir_mtime;
+    lib->catalog_mtime = catalog_mtime;
+    return true;
+  }
+
+  DIR *listing = opendir(dir);
+  if (listing == NULL) {
+    perror(dir);
+    free(old);
+    return false;
+  }
+  int capacity = 0;
+  bool catalog_changed = !indexed || index_catalog_mtime != catalog_mtime;
+  struct dirent *file;
+  while ((file = readdir(listing)) != NULL) {
+    size_t length = strlen(file->d_name);
+    if (length <= 4 || strcmp(file->d_name + length - 4, ".ch8") != 0 ||
+        length - 4 >= LIBRARY_NAME_SIZE) {
+      continue;
+    }
+    char name[LIBRARY_NAME_SIZE];
+    snprintf(name, sizeof(name), "%.*s", (int)(length - 4), file->d_name);
+    if (!add_entry(lib, &capacity, name, find_name(old, old_count, name),
+                   catalog_changed)) {
+      fprintf(stderr, "out of memory\n");
+      closedir(listing);
+      free(old);
+      library_close(lib);
+      return false;
+    }
+  }
+  closedir(listing);
+  free(old);
+  qsort(lib->entries, lib->count, sizeof(library_entry_t), compare_entries);
+
+  // creating the index changes the directory's mtime; take it after that,
+  // unless the index already existed, when a change made while listing must
+  // leave the index out of date
+  if (!indexed && access(index_path, F_OK) != 0) {
+    FILE *created = fopen(index_path, "a");
+    if (created != NULL) {
+      fclose(created);
+      dir_mtime = path_mtime(dir);
+    }
+  }
+  lib->dir_mtime = dir_mtime;
+  lib->catalog_mtime = catalog_mtime;
+  write_index(lib, index_path, dir_mtime, catalog_mtime);
+  return true;
+}
+
+void library_close(library_t *lib) {
+  free(lib->entries);
+  lib->entries = NULL;
+  lib->count = 0;
+  free(lib->catalog);
+  lib->catalog = NULL;
+  lib->catalog_count = 0;
+  lib->catalog_read = false;
+}
+
+static int hex_digit(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+const library_entry_t *library_find(const library_t *lib, const char *key) {
+  const library_entry_t *named = find_name(lib->entries, lib->count, key);
+  if (named != NULL) {
+    return named;
+  }
+  size_t digits = strlen(key);
+  if (digits < LIBRARY_MIN_HASH_DIGITS || digits > 16) {
+    return NULL;
+  }
+  uint64_t prefix = 0;
+  for (size_t i = 0; i < digits; i++) {
+    int digit = hex_digit(key[i]);
+    if (digit < 0) {
+      return NULL;
+    }
+    prefix = prefix << 4 | digit;
+  }
+  int shift = 64 - 4 * digits;
+  const library_entry_t *found = NULL;
+  for (int i = 0; i < lib->count; i++) {
+    if (lib->entries[i].hash >> shift == prefix) {
+      if (found != NULL && found->hash != lib->entries[i].hash) {
+        return NULL;
+      }
+      if (found == NULL) {
+        found = &lib->entries[i];
+      }
+    }
+  }
+  return found;
+}
+
+bool library_map(library_t *lib, library_entry_t *entry, rom_t *rom) {
+  char path[MAX_PATH];
+  snprintf(path, sizeof(path), "%s/%s.ch8", lib->dir, entry->name);
+  struct stat st;
+  const unsigned char *data = map_file(path, &st);
+  if (data == NULL) {
+    perror(path);
+    return false;
+  }
+  if (st.st_size > MAX_ROM_SIZE) {
+    print_too_big(path, st.st_size);
+    munmap((void *)data, st.st_size);
+    return false;
+  }
+  if (st.st_size != entry->size ||
+      hash_bytes(data, st.st_size) != entry->hash) {
+    // rewritten in place, which leaves the directory mtime alone and so
+    // went unnoticed by library_open; only this entry needs indexing again
+    index_file(lib, entry, data, &st);
+    char index_path[MAX_PATH];
+    snprintf(index_path, sizeof(index_path), "%s/" LIBRARY_INDEX, lib->dir);
+    write_index(lib, index_path, lib->dir_mtime, lib->catalog_mtime);
+  }
+  rom->name = entry->name;
+  rom->data = data;
+  rom->size = entry->size;
+  rom->quirks = entry->quirks;
+  return true;
+}
+
+void library_unmap(rom_t *rom) {
+  munmap((void *)rom->data, rom->size);
+  rom->data = NULL;
+  rom->size = 0;
+}
+
+bool library_load(library_t *lib, library_entry_t *entry, chip_t *chip) {
+  rom_t rom;
+  if (!library_map(lib, entry, &rom)) {
+    return false;
+  }
+  // load_program copies the image to PROGRAM_START, so the file can go
+  load_program(chip, rom.data, rom.size, rom.quirks);
+  library_unmap(&rom);
+  return true;
+}
+
+rom_t *library_select(library_t *lib, const char *dir, char *const keys[],
+                      int num_keys, int *count) {
+  int total = NUM_ROMS;
+  if (dir != NULL) {
+    if (!library_open(lib, dir)) {
+      return NULL;
+    }
+    total = lib->count;
+  }
+  bool *picked = calloc(total > 0 ? total : 1, sizeof(bool));
+  rom_t *roms = calloc(total > 0 ? total : 1, sizeof(rom_t));
+  if (picked == NULL || roms == NULL) {
+    fprintf(stderr, "out of memory\n");
+    free(picked);
+    free(roms);
+    return NULL;
+  }
+  for (int k = 0; k < num_keys; k++) {
+    int found = -1;
+    if (dir != NULL) {
+      const library_entry_t *entry = library_find(lib, keys[k]);
+      found = entry == NULL ? -1 : (int)(entry - lib->entries);
+    } else {
+      for (int i = 0; i < NUM_ROMS; i++) {
+        if (strcmp(keys[k], ROMS[i].name) == 0) {
+          found = i;
+        }
+      }
+    }
+    if (found < 0) {
+      fprintf(stderr, "unknown rom %s\n", keys[k]);
+      free(picked);
+      free(roms);
+      return NULL;
+    }
+    picked[found] = true;
+  }
+  *count = 0;
+  for (int i = 0; i < total; i++) {
+    if (num_keys > 0 && !picked[i]) {
+      continue;
+    }
+    if (dir == NULL) {
+      roms[(*count)++] = ROMS[i];
+    } else if (library_map(lib, &lib->entries[i], &roms[*count])) {
+      (*count)++;
+    } else if (num_keys > 0) {
+      // asked for by name; running everything else instead would mislead
+      free(picked);
+      free(roms);
+      return NULL;
+    }
+  }
+  free(picked);
+  return roms;
+}
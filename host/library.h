@@ -0,0 +1,100 @@
+#ifndef LIBRARY_H
+#define LIBRARY_H
+// ROM library: the .ch8 files of a directory, for host tools that run more
+// than the ROMs built in
+//
+// opening a library reads its index, LIBRARY_INDEX in the directory, which
+// holds every ROM's file name, size, modification time, content hash and
+// quirk profile. while the directory and its catalog.txt are unchanged the
+// index is used as it is, without listing the directory; otherwise the
+// directory is listed and only files that are new or whose size or time
+// changed are read, then the index is written back. files too big to load
+// above PROGRAM_START are left out. ROMs are picked by name or by a prefix
+// of their hash, and are memory-mapped rather than read when they run
+//
+// the quirk profile comes from a catalog.txt in the directory if it lists
+// the file (the format of roms/catalog.txt), read once on the first file
+// that needs indexing, else it is guessed from the
+// instructions found: any XO-CHIP one makes it xochip, any SUPER-CHIP one
+// schip, and chip8 otherwise
+//
+// index format, one ROM per line after the header, hash in hex:
+//   hachip-index <version> <directory mtime> <catalog mtime> <entries>
+//   <hash> <size> <mtime> <quirks> <file name>
+
+#include "hachip.h"
+#include "roms.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define LIBRARY_INDEX ".hachip-index"
+#define LIBRARY_INDEX_VERSION 1
+#define LIBRARY_DIR_SIZE 1024
+#define LIBRARY_NAME_SIZE 256
+// hex digits of a hash that must be given to pick a ROM by it
+#define LIBRARY_MIN_HASH_DIGITS 4
+
+typedef struct {
+  // file name without .ch8
+  char name[LIBRARY_NAME_SIZE];
+  uint32_t size;
+  long long mtime;
+  // FNV-1a of the contents
+  uint64_t hash;
+  quirks_t quirks;
+} library_entry_t;
+
+// a ROM catalog.txt lists
+typedef struct {
+  // file name without .ch8
+  char name[LIBRARY_NAME_SIZE];
+  quirks_t quirks;
+} library_catalog_entry_t;
+
+typedef struct {
+  char dir[LIBRARY_DIR_SIZE];
+  // sorted by name
+  library_entry_t *entries;
+  int count;
+  // files read and hashed while opening, 0 when the index was up to date
+  int scanned;
+  // what the index records for the directory and its catalog, kept for
+  // library_map to write it again
+  long long dir_mtime;
+  long long catalog_mtime;
+  // catalog.txt sorted by name, once catalog_read
+  library_catalog_entry_t *catalog;
+  int catalog_count;
+  bool catalog_read;
+} library_t;
+
+// opens the library in dir, refreshing its index as needed; returns false
+// with a message on stderr if dir cannot be listed
+bool library_open(library_t *lib, const char *dir);
+
+void library_close(library_t *lib);
+
+// the ROM called key, or else the one whose hash starts with key; NULL if
+// there is none or the hash prefix is ambiguous
+const library_entry_t *library_find(const library_t *lib, const char *key);
+
+// maps an entry's file into memory as a rom_t; returns false with a message
+// on stderr if it cannot be read or does not fit in memory above
+// PROGRAM_START. a file rewritten in place since it was indexed, which
+// library_open cannot tell, has its entry and the index brought up to date
+bool library_map(library_t *lib, library_entry_t *entry, rom_t *rom);
+
+void library_unmap(rom_t *rom);
+
+// maps an entry and loads it into chip with its quirk profile
+bool library_load(library_t *lib, library_entry_t *entry, chip_t *chip);
+
+// the ROMs a host tool was asked to run: with dir NULL the built-in ones
+// named in keys, in catalog order; otherwise the library in dir is opened
+// into lib and the ones picked by keys (see library_find) are mapped, in
+// library order. no keys picks every ROM. returns an array to free, its
+// length in *count, or NULL with a message on stderr
+rom_t *library_select(library_t *lib, const char *dir, char *const keys[],
+                      int num_keys, int *count);
+
+#endif
@@ -0,0 +1,135 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ROM catalog generator: reads a catalog (see roms/catalog.txt) and writes C
+// source defining every listed .ch8 file as a byte array plus the ROMS table
+// declared in roms.h. files are looked up next to the catalog
+//
+// usage: mkroms catalog > roms.c
+
+// the program area runs from 0x200 to the end of the 4K memory
+#define MAX_ROM_SIZE (4096 - 0x200)
+#define MAX_ROMS 64
+#define MAX_PATH 1024
+
+static const char *const quirk_names[] = {"chip8", "schip", "xochip"};
+#define NUM_QUIRKS (sizeof(quirk_names) / sizeof(quirk_names[0]))
+
+typedef struct {
+  char name[64];
+  char quirks[16];
+  size_t size;
+} entry_t;
+
+static entry_t entries[MAX_ROMS];
+static int num_entries;
+
+static void fail(const char *catalog, int line, const char *message,
+                 const char *arg) {
+  fprintf(stderr, "%s:%d: %s %s\n", catalog, line, message, arg);
+  exit(1);
+}
+
+// writes file as `static const unsigned char rom_<name>[]`
+static size_t emit_rom(const char *path, const char *name) {
+  FILE *in = fopen(path, "rb");
+  if (in == NULL) {
+    return 0;
+  }
+  printf("static const unsigned char rom_%s[] = {", name);
+  size_t size = 0;
+  int c;
+  while ((c = fgetc(in)) != EOF) {
+    printf("%s0x%02x,", size % 12 == 0 ? "\n    " : " ", c);
+    size++;
+  }
+  printf("};\n\n");
+  fclose(in);
+  return size;
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s catalog\n", argv[0]);
+    return 1;
+  }
+  const char *catalog = argv[1];
+  FILE *list = fopen(catalog, "r");
+  if (list == NULL) {
+    perror(catalog);
+    return 1;
+  }
+  const char *slash = strrchr(catalog, '/');
+  int dir_length = slash == NULL ? 0 : (int)(slash - catalog + 1);
+
+  printf("// generated by host/mkroms from %s; do not edit\n\n", catalog);
+  printf("#include \"roms.h\"\n\n");
+
+  char line[256];
+  for (int n = 1; fgets(line, sizeof(line), list) != NULL; n++) {
+    char file[128], quirks[16];
+    char *hash = strchr(line, '#');
+    if (hash != NULL) {
+      *hash = '\0';
+    }
+    int fields = sscanf(line, "%127s %15s", file, quirks);
+    if (fields <= 0) {
+      continue;
+    }
+    if (fields != 2) {
+      fail(catalog, n, "expected <file> <quirks>, got", line);
+    }
+    if (num_entries == MAX_ROMS) {
+      fail(catalog, n, "too many ROMs at", file);
+    }
+    size_t length = strlen(file);
+    if (length <= 4 || strcmp(file + length - 4, ".ch8") != 0 ||
+        length - 4 >= sizeof(entries[0].name)) {
+      fail(catalog, n, "not a .ch8 file name:", file);
+    }
+    entry_t *entry = &entries[num_entries++];
+    // the name doubles as part of a C identifier
+    for (size_t i = 0; i < length - 4; i++) {
+      entry->name[i] = isalnum((unsigned char)file[i]) ? file[i] : '_';
+    }
+    entry->name[length - 4] = '\0';
+
+    size_t q;
+    for (q = 0; q < NUM_QUIRKS; q++) {
+      if (strcmp(quirks, quirk_names[q]) == 0) {
+        break;
+      }
+    }
+    if (q == NUM_QUIRKS) {
+      fail(catalog, n, "unknown quirks", quirks);
+    }
+    for (size_t i = 0; i <= strlen(quirks); i++) {
+      entry->quirks[i] = toupper((unsigned char)quirks[i]);
+    }
+
+    char path[MAX_PATH];
+    snprintf(path, sizeof(path), "%.*s%s", dir_length, catalog, file);
+    entry->size = emit_rom(path, entry->name);
+    if (entry->size == 0) {
+      fail(catalog, n, "missing or empty ROM", path);
+    }
+    if (entry->size > MAX_ROM_SIZE) {
+      fail(catalog, n, "ROM does not fit in memory:", path);
+    }
+  }
+  fclose(list);
+  if (num_entries == 0) {
+    fprintf(stderr, "%s: no ROMs listed\n", catalog);
+    return 1;
+  }
+
+  printf("const rom_t ROMS[] = {\n");
+  for (int i = 0; i < num_entries; i++) {
+    printf("    {\"%s\", rom_%s, %zu, QUIRKS_%s},\n", entries[i].name,
+           entries[i].name, entries[i].size, entries[i].quirks);
+  }
+  printf("};\n\nconst int NUM_ROMS = %d;\n", num_entries);
+  return 0;
+}
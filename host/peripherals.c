@@ -0,0 +1,189 @@
+#include "peripherals.h"
+#include "audio.h"
+#include "headless.h"
+#include "timer.h"
+#include <string.h>
+
+// headless implementation of peripherals.h: nothing is shown, the display is
+// recorded into a shadow buffer and keys come from a script
+
+static int k_display_width;
+static int k_display_height;
+static uint64_t display[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+static unsigned long rows_drawn;
+static unsigned long frames;
+static stream_t *display_stream;
+
+static const unsigned short *key_script;
+static int key_script_count;
+static int key_script_hold;
+static unsigned long key_calls;
+
+// the sink stands in for an output device running at AUDIO_SAMPLE_RATE
+// against emulated time: every fill_audio call is one frame, for which it
+// takes that frame's samples before making more
+static audio_t audio;
+static FILE *audio_sink;
+static bool audio_sink_wav;
+static unsigned long audio_frames;
+static unsigned long audio_written;
+
+void init_keyboard(void) {
+  key_script = NULL;
+  key_script_count = 0;
+  key_calls = 0;
+}
+
+void init_display(int width, int height) {
+  k_display_width = width;
+  k_display_height = height;
+  memset(display, 0, sizeof(display));
+  rows_drawn = 0;
+  frames = 0;
+}
+
+void update_display(const uint64_t (*planes)[HIRES_HEIGHT][ROW_WORDS],
+                    int width, int height, uint64_t dirty) {
+  k_display_width = width;
+  k_display_height = height;
+  for (int y = 0; y < height; y++) {
+    if (dirty & ((uint64_t)1 << y)) {
+      for (int p = 0; p < DISPLAY_PLANES; p++) {
+        memcpy(display[p][y], planes[p][y], sizeof(display[p][y]));
+      }
+      rows_drawn++;
+    }
+  }
+  if (display_stream != NULL) {
+    stream_update(display_stream, planes, width, height, dirty);
+  }
+  frames++;
+}
+
+void show_menu(const char *const *names, int count) {
+  // host tools pick their ROMs on the command line
+}
+
+void set_keys(bool *keypad) {
+  if (key_script_count == 0) {
+    memset(keypad, false, 16);
+    return;
+  }
+  unsigned short keys =
+      key_script[(key_calls++ / key_script_hold) % key_script_count];
+  for (int i = 0; i < 16; i++) {
+    keypad[i] = (keys >> i) & 1;
+  }
+}
+
+bool rewind_held(void) { return false; }
+
+bool report_requested(void) { return false; }
+
+bool log_requested(void) { return false; }
+
+bool trace_requested(void) { return false; }
+
+bool turbo_requested(void) { return false; }
+
+bool menu_requested(void) { return false; }
+
+void init_audio(void) {
+  audio_init(&audio);
+  audio_sink = NULL;
+  audio_frames = 0;
+  audio_written = 0;
+}
+
+void play_sound(bool on, const unsigned char *pattern, unsigned char pitch) {
+  audio_post(&audio, on, pattern, pitch);
+}
+
+void fill_audio(void) {
+  if (audio_sink == NULL) {
+    audio_fill(&audio);
+    return;
+  }
+  // the frame just run is played from what was queued before it
+  audio_frames++;
+  unsigned long due = audio_frames * AUDIO_SAMPLE_RATE / 60;
+  while (audio_written < due) {
+    uint8_t sample;
+    if (!audio_take(&audio, &sample)) {
+      sample = AUDIO_SILENCE;
+    }
+    fputc(sample, audio_sink);
+    audio_written++;
+  }
+  audio_fill(&audio);
+}
+
+unsigned long audio_underruns(void) { return audio.underruns; }
+
+void sleep_us(unsigned int us) { timer_delay_us(us); }
+
+void headless_set_key_script(const unsigned short *keys, int count, int hold) {
+  key_script = keys;
+  key_script_count = count;
+  key_script_hold = hold > 0 ? hold : 1;
+  key_calls = 0;
+}
+
+// the canonical 44-byte header of a mono 8-bit PCM file holding samples
+static void write_wav_header(FILE *out, unsigned long samples) {
+  unsigned char header[44] = "RIFF....WAVEfmt ";
+  unsigned long fields[] = {36 + samples, 16, 1 | 1 << 16, AUDIO_SAMPLE_RATE,
+                            AUDIO_SAMPLE_RATE, 1 | 8 << 16};
+  int offsets[] = {4, 16, 20, 24, 28, 32};
+  for (int f = 0; f < 6; f++) {
+    for (int b = 0; b < 4; b++) {
+      header[offsets[f] + b] = fields[f] >> (8 * b);
+    }
+  }
+  memcpy(header + 36, "data", 4);
+  for (int b = 0; b < 4; b++) {
+    header[40 + b] = samples >> (8 * b);
+  }
+  fwrite(header, 1, sizeof(header), out);
+}
+
+void headless_open_audio(FILE *out, bool wav) {
+  audio_sink = out;
+  audio_sink_wav = wav;
+  audio_frames = 0;
+  audio_written = 0;
+  if (wav) {
+    // sizes are filled in by headless_close_audio
+    write_wav_header(out, 0);
+  }
+}
+
+unsigned long headless_close_audio(void) {
+  if (audio_sink != NULL && audio_sink_wav) {
+    fseek(audio_sink, 0, SEEK_SET);
+    write_wav_header(audio_sink, audio_written);
+  }
+  audio_sink = NULL;
+  return audio_written;
+}
+
+void headless_set_stream(stream_t *stream) { display_stream = stream; }
+
+unsigned long headless_rows_drawn(void) { return rows_drawn; }
+
+unsigned long headless_frames(void) { return frames; }
+
+void headless_dump_display(FILE *out) {
+  // one character per colour, see display.h
+  static const char shades[1 << DISPLAY_PLANES] = {'.', '#', '+', '%'};
+  for (int y = 0; y < k_display_height; y++) {
+    for (int x = 0; x < k_display_width; x++) {
+      int color = 0;
+      for (int p = 0; p < DISPLAY_PLANES; p++) {
+        color |= ((display[p][y][x / 64] >> (63 - x % 64)) & 1) << p;
+      }
+      fputc(shades[color], out);
+    }
+    fputc('\n', out);
+  }
+}
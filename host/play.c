@@ -0,0 +1,243 @@
+#include "hachip.h"
+#include "roms.h"
+#include "scheduler.h"
+#include "timer.h"
+#include "triple.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// threaded player: runs one ROM on the calling thread and shows its display
+// from a second one. finished frames go from the emulation to the presenter
+// through a triple buffer (triple.h), so a slow sink costs presented frames,
+// never emulation speed, and every frame shown is whole
+//
+// usage: play [-f frames] [-i instructions] [-r] [-o sink] [-d ms] rom
+//   -f  frames to run (default 600)
+//   -i  instructions per frame (default DEFAULT_INSTRUCTIONS_PER_FRAME)
+//   -r  run at 60 frames per second instead of back to back
+//   -o  where frames go: term (text on standard output, the default), none,
+//       or a file name ending in .ppm, replaced by each new frame
+//   -d  extra time the presenter takes per frame, to stand in for a slow
+//       display
+
+#define DEFAULT_FRAMES 600
+// set_keys calls each key mask is held for
+#define KEY_HOLD 4
+
+typedef enum { SINK_TERM, SINK_NONE, SINK_PPM } sink_t;
+
+static triple_t frames;
+// set by the emulation thread once it has published its last frame
+static bool done;
+
+static sink_t sink = SINK_TERM;
+static const char *ppm_path;
+static unsigned int present_delay_ms;
+static unsigned long presented;
+static unsigned long torn;
+
+// presses each key in turn with a release in between, like bench
+static void play_set_keys(chip_t *chip, bool *keypad) {
+  static unsigned long calls;
+  unsigned long step = calls++ / KEY_HOLD;
+  for (int i = 0; i < 16; i++) {
+    keypad[i] = step % 2 == 1 && i == (step / 2) % 16;
+  }
+}
+
+// copies the whole display, not just the dirty rows, so every published
+// frame stands on its own
+static void play_update_display(chip_t *chip, uint64_t dirty) {
+  const scheduler_t *sched = chip->USER;
+  frame_t *frame = triple_back(&frames);
+  frame->number = sched->frames + 1;
+  frame->width = chip->HIRES ? HIRES_WIDTH : DISPLAY_WIDTH;
+  frame->height = chip->HIRES ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+  memcpy(frame->planes, chip->PIXELS, sizeof(frame->planes));
+  frame->checksum = frame_checksum(frame);
+  triple_publish(&frames);
+}
+
+static void play_play_sound(chip_t *chip, bool on) {}
+
+static const chip_io_t PLAY_IO = {
+    .update_display = play_update_display,
+    .set_keys = play_set_keys,
+    .play_sound = play_play_sound,
+};
+
+static int pixel_color(const frame_t *frame, int x, int y) {
+  int color = 0;
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    color |= ((frame->planes[p][y][x / 64] >> (63 - x % 64)) & 1) << p;
+  }
+  return color;
+}
+
+static void show_term(const frame_t *frame) {
+  // one character per colour, as in headless_dump_display
+  static const char shades[1 << DISPLAY_PLANES] = {'.', '#', '+', '%'};
+  static char text[HIRES_HEIGHT * (HIRES_WIDTH + 1) + 1];
+  char *out = text;
+  for (int y = 0; y < frame->height; y++) {
+    for (int x = 0; x < frame->width; x++) {
+      *out++ = shades[pixel_color(frame, x, y)];
+    }
+    *out++ = '\n';
+  }
+  *out = '\0';
+  // home the cursor and clear, then the frame in one write
+  printf("\033[H\033[2J%sframe %lu\n", text, frame->number);
+  fflush(stdout);
+}
+
+static void show_ppm(const frame_t *frame) {
+  // the same colours as on the Pi
+  static const unsigned char palette[1 << DISPLAY_PLANES][3] = {
+      {0, 0, 0}, {255, 255, 255}, {170, 170, 170}, {85, 85, 85}};
+  // written next to the target and renamed over it, so a viewer reloading
+  // the file never reads half of one
+  char tmp[1024];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", ppm_path);
+  FILE *out = fopen(tmp, "wb");
+  if (out == NULL) {
+    perror(tmp);
+    exit(1);
+  }
+  fprintf(out, "P6\n%d %d\n255\n", frame->width, frame->height);
+  for (int y = 0; y < frame->height; y++) {
+    for (int x = 0; x < frame->width; x++) {
+      fwrite(palette[pixel_color(frame, x, y)], 1, 3, out);
+    }
+  }
+  fclose(out);
+  rename(tmp, ppm_path);
+}
+
+static void sleep_ms(unsigned int ms) {
+  struct timespec ts = {ms / 1000, (ms % 1000) * 1000000L};
+  nanosleep(&ts, NULL);
+}
+
+static void *presenter(void *arg) {
+  for (;;) {
+    // read before taking, so a frame published just before done is set is
+    // still taken below
+    bool finished = __atomic_load_n(&done, __ATOMIC_ACQUIRE);
+    const frame_t *frame = triple_take(&frames);
+    if (frame == NULL) {
+      if (finished) {
+        return NULL;
+      }
+      sleep_ms(1);
+      continue;
+    }
+    if (frame_checksum(frame) != frame->checksum) {
+      torn++;
+    }
+    if (sink == SINK_TERM) {
+      show_term(frame);
+    } else if (sink == SINK_PPM) {
+      show_ppm(frame);
+    }
+    presented++;
+    if (present_delay_ms > 0) {
+      sleep_ms(present_delay_ms);
+    }
+  }
+}
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+  unsigned long run_frames = DEFAULT_FRAMES;
+  unsigned int instructions_per_frame = DEFAULT_INSTRUCTIONS_PER_FRAME;
+  bool realtime = false;
+  const rom_t *rom = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-f") == 0 && i + 1 < argc) {
+      run_frames = strtoul(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "-i") == 0 && i + 1 < argc) {
+      instructions_per_frame = strtoul(argv[++i], NULL, 0);
+    } else if (strcmp(argv[i], "-r") == 0) {
+      realtime = true;
+    } else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+      const char *name = argv[++i];
+      size_t length = strlen(name);
+      if (strcmp(name, "term") == 0) {
+        sink = SINK_TERM;
+      } else if (strcmp(name, "none") == 0) {
+        sink = SINK_NONE;
+      } else if (length > 4 && strcmp(name + length - 4, ".ppm") == 0) {
+        sink = SINK_PPM;
+        ppm_path = name;
+      } else {
+        fprintf(stderr, "unknown sink %s\n", name);
+        return 1;
+      }
+    } else if (strcmp(argv[i], "-d") == 0 && i + 1 < argc) {
+      present_delay_ms = atoi(argv[++i]);
+    } else {
+      rom = NULL;
+      for (int j = 0; j < NUM_ROMS; j++) {
+        if (strcmp(argv[i], ROMS[j].name) == 0) {
+          rom = &ROMS[j];
+        }
+      }
+      if (rom == NULL) {
+        fprintf(stderr,
+                "usage: %s [-f frames] [-i instructions] [-r] [-o sink] "
+                "[-d ms] rom\n",
+                argv[0]);
+        return 1;
+      }
+    }
+  }
+  if (rom == NULL) {
+    fprintf(stderr, "no rom given\n");
+    return 1;
+  }
+
+  timer_init();
+  // chip_t carries its caches, too big for the stack
+  static chip_t chip;
+  init_chip(&chip, &PLAY_IO);
+  load_program(&chip, rom->data, rom->size, rom->quirks);
+  scheduler_t sched;
+  scheduler_init(&sched, &chip, instructions_per_frame);
+  if (!realtime) {
+    sched.frame_ticks = 0;
+  }
+  chip.USER = &sched;
+  triple_init(&frames);
+
+  pthread_t thread;
+  if (pthread_create(&thread, NULL, presenter, NULL) != 0) {
+    fprintf(stderr, "cannot start the presenter\n");
+    return 1;
+  }
+  double start = now_seconds();
+  while (sched.frames < run_frames) {
+    run_frame(&sched);
+  }
+  double elapsed = now_seconds() - start;
+  __atomic_store_n(&done, true, __ATOMIC_RELEASE);
+  pthread_join(thread, NULL);
+
+  // only those run, not the ones skipped in idle loops
+  double instructions = (double)sched.frames * instructions_per_frame -
+                        sched.idle_instructions;
+  printf("%s: %lu frames in %.3f s, %.0f instr/sec; %lu published, "
+         "%lu presented, %lu torn\n",
+         rom->name, sched.frames, elapsed, instructions / elapsed,
+         frames.published, presented, torn);
+  return 0;
+}
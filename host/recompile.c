@@ -0,0 +1,279 @@
+#include "opcodes.h"
+#include "roms.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ahead-of-time recompiler: writes C source defining every built-in ROM as
+// a compiled program plus the AOT_PROGRAMS table declared in aot.h
+//
+// blocks are found by following the program from PROGRAM_START: each one
+// runs up to an instruction that can change the flow (jumps, calls, returns,
+// skips) or write memory, and what follows it is looked at in turn. FX0A,
+// 0NNN and undecodable words end a block without being part of it and are
+// left to the interpreter, as is whatever only a computed jump (BNNN)
+// reaches. instructions are decoded here with the ROM's quirks and emitted
+// as calls to the exec_ functions in exec.h, which the compiler inlines
+//
+// a program is one function with a label per block. a block that ends in a
+// jump, call or skip goes straight on to the blocks it can reach with a
+// goto; only returns and computed jumps look PC up in the switch at the top.
+// every C identifier is prefixed with aot_, since ROM names, which mkroms
+// keeps as they are, may start with a digit
+//
+// usage: recompile > recompiled.c
+
+// instructions per block at most; a longer run is split
+#define MAX_COMPILED_INSTRS 64
+
+static const char *const op_names[NUM_OPS] = {
+#define OP_NAME(name) [OP_##name] = #name,
+    OPCODE_LIST(OP_NAME)
+#undef OP_NAME
+};
+
+static const char *const quirk_names[NUM_QUIRKS] = {"chip8", "schip",
+                                                    "xochip"};
+
+typedef struct {
+  unsigned short start;
+  unsigned short len;
+} found_t;
+
+static found_t blocks[MEM_SIZE];
+static int num_blocks;
+static bool is_start[MEM_SIZE];
+// where each of blocks starts, once all are found
+static bool is_block[MEM_SIZE];
+static unsigned short pending[MEM_SIZE];
+static int num_pending;
+
+static const rom_t *rom;
+
+static bool in_rom(unsigned int addr) {
+  return addr >= PROGRAM_START && addr + 1 < PROGRAM_START + rom->size;
+}
+
+static unsigned short opcode_at(unsigned int addr) {
+  const unsigned char *code = rom->data + (addr - PROGRAM_START);
+  return code[0] << 8 | code[1];
+}
+
+static void add_start(unsigned int addr) {
+  if (in_rom(addr) && !is_start[addr]) {
+    is_start[addr] = true;
+    pending[num_pending++] = addr;
+  }
+}
+
+// ends a block after it, with the addresses it can go to next
+static bool ends_block(const instr_t *in, unsigned int pc) {
+  switch (in->op) {
+  case OP_1NNN:
+    add_start(in->nnn);
+    return true;
+  case OP_2NNN:
+    add_start(in->nnn);
+    add_start(pc + 2);
+    return true;
+  case OP_3XNN:
+  case OP_4XNN:
+  case OP_5XY0:
+  case OP_9XY0:
+  case OP_EX9E:
+  case OP_EXA1:
+    add_start(pc + 2);
+    add_start(pc + 4);
+    return true;
+  // may write into the code that follows
+  case OP_FX33:
+  case OP_FX55:
+  case OP_FX55_INC:
+    add_start(pc + 2);
+    return true;
+  case OP_00EE:
+  case OP_00FD:
+  case OP_BNNN:
+  case OP_BXNN:
+    return true;
+  }
+  return false;
+}
+
+static void find_block(unsigned int start) {
+  unsigned int pc = start;
+  int len = 0;
+  bool ended = false;
+  while (!ended && in_rom(pc) && len < MAX_COMPILED_INSTRS) {
+    instr_t in = decode_instr(opcode_at(pc), rom->quirks);
+    if (in.op == OP_FX0A) {
+      // the interpreter waits for the key, then carries on here
+      add_start(pc + 2);
+      break;
+    }
+    if (in.op == OP_UNKNOWN || in.op == OP_0NNN) {
+      break;
+    }
+    len++;
+    ended = ends_block(&in, pc);
+    pc += 2;
+  }
+  if (!ended && len == MAX_COMPILED_INSTRS) {
+    add_start(pc);
+  }
+  if (len > 0) {
+    blocks[num_blocks++] = (found_t){start, len};
+  }
+}
+
+static int compare_blocks(const void *a, const void *b) {
+  return ((const found_t *)a)->start - ((const found_t *)b)->start;
+}
+
+// jumps to the block at addr if there is one, else hands PC to the
+// interpreter
+static void emit_goto(unsigned int addr) {
+  if (addr < MEM_SIZE && is_block[addr]) {
+    printf("  goto b_%03x;\n", addr);
+  } else {
+    printf("  return count;\n");
+  }
+}
+
+static instr_t last_instr(const found_t *block) {
+  unsigned int last = block->start + 2 * (block->len - 1);
+  return decode_instr(opcode_at(last), rom->quirks);
+}
+
+// whether the block only finds out where it goes when it runs
+static bool ends_dynamically(const found_t *block) {
+  switch (last_instr(block).op) {
+  case OP_00EE:
+  case OP_00FD:
+  case OP_BNNN:
+  case OP_BXNN:
+    return true;
+  }
+  return false;
+}
+
+// what runs after the block: straight on to the blocks it can reach where
+// they are known, else back through the switch
+static void emit_next(const found_t *block) {
+  unsigned int end = block->start + 2 * block->len;
+  instr_t in = last_instr(block);
+  if (ends_dynamically(block)) {
+    printf("  goto dispatch;\n");
+    return;
+  }
+  switch (in.op) {
+  case OP_1NNN:
+  case OP_2NNN:
+    emit_goto(in.nnn);
+    return;
+  case OP_3XNN:
+  case OP_4XNN:
+  case OP_5XY0:
+  case OP_9XY0:
+  case OP_EX9E:
+  case OP_EXA1:
+    printf("  if (chip->PC == 0x%03x) {\n  ", end + 2);
+    emit_goto(end + 2);
+    printf("  }\n");
+    emit_goto(end);
+    return;
+  }
+  emit_goto(end);
+}
+
+static void emit_program(void) {
+  memset(is_start, 0, sizeof(is_start));
+  memset(is_block, 0, sizeof(is_block));
+  num_blocks = 0;
+  num_pending = 0;
+  add_start(PROGRAM_START);
+  while (num_pending > 0) {
+    find_block(pending[--num_pending]);
+  }
+  qsort(blocks, num_blocks, sizeof(found_t), compare_blocks);
+
+  int instructions = 0;
+  bool dispatches = false;
+  for (int b = 0; b < num_blocks; b++) {
+    instructions += blocks[b].len;
+    is_block[blocks[b].start] = true;
+    dispatches = dispatches || ends_dynamically(&blocks[b]);
+  }
+  printf("// %s (%s): %d blocks, %d instructions\n\n", rom->name,
+         quirk_names[rom->quirks], num_blocks, instructions);
+  if (num_blocks == 0) {
+    return;
+  }
+  printf("static const aot_block_t aot_%s_blocks[] = {\n", rom->name);
+  for (int b = 0; b < num_blocks; b++) {
+    printf("    {0x%03x, %d},\n", blocks[b].start, blocks[b].len);
+  }
+  printf("};\n\n");
+
+  printf("static unsigned int aot_%s_run(chip_t *chip, unsigned int count) "
+         "{\n",
+         rom->name);
+  printf("  const bool *dead = chip->COMPILED.dead;\n");
+  if (dispatches) {
+    printf("dispatch:\n");
+  }
+  printf("  switch (chip->PC) {\n");
+  for (int b = 0; b < num_blocks; b++) {
+    printf("  case 0x%03x:\n    goto b_%03x;\n", blocks[b].start,
+           blocks[b].start);
+  }
+  printf("  }\n  return count;\n");
+  for (int b = 0; b < num_blocks; b++) {
+    unsigned int start = blocks[b].start;
+    int len = blocks[b].len;
+    printf("b_%03x:\n", start);
+    printf("  if (count < %d || dead[0x%03x]) {\n", len, start);
+    printf("    chip->PC = 0x%03x;\n    return count;\n  }\n", start);
+    printf("  count -= %d;\n", len);
+    for (int i = 0; i < len; i++) {
+      unsigned short opcode = opcode_at(start + 2 * i);
+      const char *name = op_names[decode_instr(opcode, rom->quirks).op];
+      // only the last instruction can use PC
+      if (i == len - 1) {
+        printf("  chip->PC = 0x%03x;\n", start + 2 * len);
+      }
+      printf("  exec_%s(chip, AOT_INSTR(%s, 0x%04x));\n", name, name,
+             opcode);
+    }
+    emit_next(&blocks[b]);
+  }
+  printf("}\n\n");
+}
+
+int main(int argc, char *argv[]) {
+  if (argc != 1) {
+    fprintf(stderr, "usage: %s > recompiled.c\n", argv[0]);
+    return 1;
+  }
+  printf("// generated by host/recompile from the ROMs in roms.c; do not "
+         "edit\n\n");
+  printf("#include \"aot.h\"\n#include \"exec.h\"\n\n");
+  int *blocks_of = calloc(NUM_ROMS, sizeof(int));
+  for (int i = 0; i < NUM_ROMS; i++) {
+    rom = &ROMS[i];
+    emit_program();
+    blocks_of[i] = num_blocks;
+  }
+  printf("const aot_program_t AOT_PROGRAMS[] = {\n");
+  for (int i = 0; i < NUM_ROMS; i++) {
+    if (blocks_of[i] == 0) {
+      printf("    {&ROMS[%d], NULL, 0, NULL},\n", i);
+    } else {
+      printf("    {&ROMS[%d], aot_%s_blocks, %d, aot_%s_run},\n", i,
+             ROMS[i].name, blocks_of[i], ROMS[i].name);
+    }
+  }
+  printf("};\n\n");
+  printf("const int NUM_AOT_PROGRAMS = %d;\n", NUM_ROMS);
+  return 0;
+}
@@ -0,0 +1,293 @@
+#include "stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+static const char stream_magic[3] = {'H', 'C', 'S'};
+
+static unsigned char *put_le(unsigned char *out, uint64_t value, int bytes) {
+  for (int b = 0; b < bytes; b++) {
+    *out++ = value >> (8 * b);
+  }
+  return out;
+}
+
+static uint64_t get_le(const unsigned char *in, int bytes) {
+  uint64_t value = 0;
+  for (int b = 0; b < bytes; b++) {
+    value |= (uint64_t)in[b] << (8 * b);
+  }
+  return value;
+}
+
+static void write_all(stream_t *stream, const unsigned char *data,
+                      size_t size) {
+  while (size > 0 && !stream->failed) {
+    ssize_t written = write(stream->fd, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      // the reader went away; the machine runs on without it
+      perror("display stream");
+      stream->failed = true;
+      return;
+    }
+    data += written;
+    size -= written;
+    stream->bytes += written;
+  }
+}
+
+static int connect_unix(const char *path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd >= 0 &&
+      connect(fd, (const struct sockaddr *)&address, sizeof(address)) != 0) {
+    close(fd);
+    fd = -1;
+  }
+  return fd;
+}
+
+bool stream_open(stream_t *stream, const char *target) {
+  memset(stream, 0, sizeof(*stream));
+  if (strncmp(target, "unix:", 5) == 0) {
+    stream->fd = connect_unix(target + 5);
+  } else {
+    stream->fd = open(target, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  }
+  if (stream->fd < 0) {
+    perror(target);
+    return false;
+  }
+  // a closed pipe or socket shows up as a failed write instead
+  signal(SIGPIPE, SIG_IGN);
+  return true;
+}
+
+void stream_begin(stream_t *stream, const char *name) {
+  unsigned char header[4 + 1 + STREAM_NAME_SIZE];
+  size_t length = strlen(name);
+  if (length >= STREAM_NAME_SIZE) {
+    length = STREAM_NAME_SIZE - 1;
+  }
+  memcpy(header, stream_magic, sizeof(stream_magic));
+  header[3] = STREAM_VERSION;
+  header[4] = length;
+  memcpy(header + 5, name, length);
+  write_all(stream, header, 5 + length);
+  memset(stream->shown, 0, sizeof(stream->shown));
+  stream->height = 0;
+  stream->key = true;
+  stream->updates = 0;
+}
+
+// row as STREAM_ROW_BYTES bytes, planes then words, most significant first
+static void row_bytes(const uint64_t (*planes)[HIRES_HEIGHT][ROW_WORDS],
+                      int y, unsigned char *out) {
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    for (int w = 0; w < ROW_WORDS; w++) {
+      for (int b = 7; b >= 0; b--) {
+        *out++ = planes[p][y][w] >> (8 * b);
+      }
+    }
+  }
+}
+
+// packs delta into packets (see stream.h); returns the end of them
+static unsigned char *pack_row(const unsigned char *delta,
+                               unsigned char *out) {
+  int i = 0;
+  while (i < STREAM_ROW_BYTES) {
+    int start = i;
+    if (delta[i] == 0) {
+      while (i < STREAM_ROW_BYTES && delta[i] == 0) {
+        i++;
+      }
+      *out++ = 0x7F + (i - start);
+      continue;
+    }
+    // a lone zero costs less inside the literal than as a run of its own
+    while (i < STREAM_ROW_BYTES &&
+           (delta[i] != 0 ||
+            (i + 1 < STREAM_ROW_BYTES && delta[i + 1] != 0))) {
+      i++;
+    }
+    *out++ = i - start - 1;
+    memcpy(out, delta + start, i - start);
+    out += i - start;
+  }
+  return out;
+}
+
+void stream_update(stream_t *stream,
+                   const uint64_t (*planes)[HIRES_HEIGHT][ROW_WORDS],
+                   int width, int height, uint64_t dirty) {
+  if (stream->failed) {
+    return;
+  }
+  stream->updates++;
+  // switching resolution clears the screen; start over from a blank one
+  if (height != stream->height) {
+    memset(stream->shown, 0, sizeof(stream->shown));
+    stream->height = height;
+    stream->key = true;
+  }
+  if (stream->key) {
+    dirty = ~(uint64_t)0;
+  }
+
+  unsigned char record[STREAM_RECORD_SIZE];
+  unsigned char *out = record + 15;
+  uint64_t changed = 0;
+  for (int y = 0; y < height; y++) {
+    if (!(dirty & ((uint64_t)1 << y))) {
+      continue;
+    }
+    unsigned char now[STREAM_ROW_BYTES], before[STREAM_ROW_BYTES];
+    row_bytes(planes, y, now);
+    row_bytes((const uint64_t(*)[HIRES_HEIGHT][ROW_WORDS])stream->shown, y,
+              before);
+    bool same = true;
+    for (int i = 0; i < STREAM_ROW_BYTES; i++) {
+      now[i] ^= before[i];
+      same &= now[i] == 0;
+    }
+    if (same) {
+      continue;
+    }
+    changed |= (uint64_t)1 << y;
+    out = pack_row(now, out);
+    for (int p = 0; p < DISPLAY_PLANES; p++) {
+      memcpy(stream->shown[p][y], planes[p][y], sizeof(stream->shown[p][y]));
+    }
+  }
+  // a key record goes out even when blank, to carry the resolution
+  if (changed == 0 && !stream->key) {
+    return;
+  }
+  record[0] = (stream->key ? STREAM_KEY : 0) |
+              (width == HIRES_WIDTH ? STREAM_HIRES : 0);
+  put_le(record + 1, out - record - 3, 2);
+  put_le(record + 3, stream->updates, 4);
+  put_le(record + 7, changed, 8);
+  stream->key = false;
+  stream->records++;
+  write_all(stream, record, out - record);
+}
+
+void stream_close(stream_t *stream) {
+  if (stream->fd >= 0) {
+    close(stream->fd);
+  }
+  stream->fd = -1;
+}
+
+void stream_reader_init(stream_reader_t *reader) {
+  memset(reader, 0, sizeof(*reader));
+  reader->width = DISPLAY_WIDTH;
+  reader->height = DISPLAY_HEIGHT;
+}
+
+// applies a row's packets to row y; returns the bytes they took, or -1
+static long unpack_row(stream_reader_t *reader, int y,
+                       const unsigned char *in, size_t size) {
+  unsigned char delta[STREAM_ROW_BYTES];
+  size_t used = 0;
+  int filled = 0;
+  while (filled < STREAM_ROW_BYTES) {
+    if (used == size) {
+      return -1;
+    }
+    unsigned char packet = in[used++];
+    int count = packet >= 0x80 ? packet - 0x7F : packet + 1;
+    if (filled + count > STREAM_ROW_BYTES ||
+        (packet < 0x80 && used + count > size)) {
+      return -1;
+    }
+    if (packet >= 0x80) {
+      memset(delta + filled, 0, count);
+    } else {
+      memcpy(delta + filled, in + used, count);
+      used += count;
+    }
+    filled += count;
+  }
+  const unsigned char *bytes = delta;
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    for (int w = 0; w < ROW_WORDS; w++) {
+      uint64_t word = 0;
+      for (int b = 0; b < 8; b++) {
+        word = word << 8 | *bytes++;
+      }
+      reader->planes[p][y][w] ^= word;
+    }
+  }
+  return used;
+}
+
+long stream_read(stream_reader_t *reader, const unsigned char *data,
+                 size_t size) {
+  if (size < 3) {
+    return 0;
+  }
+  if (memcmp(data, stream_magic, sizeof(stream_magic)) == 0) {
+    if (size < 5 || size < 5 + (size_t)data[4]) {
+      return 0;
+    }
+    if (data[3] != STREAM_VERSION || data[4] >= STREAM_NAME_SIZE) {
+      return -1;
+    }
+    memcpy(reader->name, data + 5, data[4]);
+    reader->name[data[4]] = '\0';
+    memset(reader->planes, 0, sizeof(reader->planes));
+    reader->width = DISPLAY_WIDTH;
+    reader->height = DISPLAY_HEIGHT;
+    reader->update = 0;
+    reader->runs++;
+    reader->bytes += 5 + data[4];
+    return 5 + data[4];
+  }
+  size_t length = 3 + get_le(data + 1, 2);
+  if (reader->runs == 0 || length < 15 || length > STREAM_RECORD_SIZE) {
+    return -1;
+  }
+  if (size < length) {
+    return 0;
+  }
+  if (data[0] & STREAM_KEY) {
+    memset(reader->planes, 0, sizeof(reader->planes));
+  }
+  bool hires = data[0] & STREAM_HIRES;
+  reader->width = hires ? HIRES_WIDTH : DISPLAY_WIDTH;
+  reader->height = hires ? HIRES_HEIGHT : DISPLAY_HEIGHT;
+  reader->update = get_le(data + 3, 4);
+  uint64_t changed = get_le(data + 7, 8);
+  size_t used = 15;
+  for (int y = 0; y < HIRES_HEIGHT; y++) {
+    if (changed & ((uint64_t)1 << y)) {
+      long taken = unpack_row(reader, y, data + used, length - used);
+      if (taken < 0) {
+        return -1;
+      }
+      used += taken;
+    }
+  }
+  if (used != length) {
+    return -1;
+  }
+  reader->records++;
+  reader->bytes += length;
+  return length;
+}
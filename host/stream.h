@@ -0,0 +1,92 @@
+#ifndef STREAM_H
+#define STREAM_H
+// display stream: the changes a headless machine makes to its display, sent
+// as compact binary records to a file, a pipe or a Unix socket, for
+// host/view to show
+//
+// a record is only written for an update that changed something, and holds
+// only the rows it changed, each run-length coded as its difference from the
+// row before. a program drawing a sprite costs a few bytes per row it
+// touches, and one sitting still costs nothing however fast it runs
+//
+// all numbers little-endian. a stream is a header per machine run:
+//   "HCS" <version> <name length: 1> <name>
+// followed by a record per update:
+//   <flags: 1> <size of the rest: 2> <update number: 4>
+//   <changed rows: 8, bit y = row y> <changed rows, top to bottom>
+// where each changed row is its 32 bytes (plane 0 words then plane 1 words,
+// each word most significant byte first, as in display.h) XORed with the row
+// it replaces and cut into packets:
+//   0x00..0x7F  that many plus one bytes follow as they are
+//   0x80..0xFF  that many minus 0x7F zero bytes
+// a record flagged STREAM_KEY is against a blank display: the first one of a
+// run, and any where the resolution changed
+
+#include "display.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define STREAM_VERSION 1
+#define STREAM_NAME_SIZE 64
+
+// record flags
+#define STREAM_KEY 1
+#define STREAM_HIRES 2
+
+// bytes per row in the XORed form, and the most a record can take
+#define STREAM_ROW_BYTES (DISPLAY_PLANES * ROW_WORDS * 8)
+#define STREAM_RECORD_SIZE                                                    \
+  (15 + HIRES_HEIGHT * (STREAM_ROW_BYTES + STREAM_ROW_BYTES / 2 + 1))
+
+typedef struct {
+  int fd;
+  // the display as the reader has it
+  uint64_t shown[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+  int height;
+  bool key;
+  uint32_t updates;
+  // records and bytes written, over every run
+  unsigned long records;
+  unsigned long bytes;
+  // set once a write fails; nothing more is written
+  bool failed;
+} stream_t;
+
+// opens target: unix:path to connect to a Unix socket, anything else a file
+// or FIFO to write (host tools print their reports on standard output, so
+// it is not offered); returns false with a message on stderr if it cannot
+bool stream_open(stream_t *stream, const char *target);
+
+// starts the run of a machine called name; the next record is a key one
+void stream_begin(stream_t *stream, const char *name);
+
+// writes a record for the rows flagged in dirty that differ from what the
+// reader has, if any do; arguments as for update_display
+void stream_update(stream_t *stream,
+                   const uint64_t (*planes)[HIRES_HEIGHT][ROW_WORDS],
+                   int width, int height, uint64_t dirty);
+
+void stream_close(stream_t *stream);
+
+typedef struct {
+  char name[STREAM_NAME_SIZE];
+  int width;
+  int height;
+  uint64_t planes[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+  // number of the last record applied
+  uint32_t update;
+  // runs started, records applied and bytes read
+  unsigned long runs;
+  unsigned long records;
+  unsigned long bytes;
+} stream_reader_t;
+
+void stream_reader_init(stream_reader_t *reader);
+
+// applies the header or record at the start of data; returns its length, 0
+// if size does not hold all of it yet, or -1 if it is not part of a stream
+long stream_read(stream_reader_t *reader, const unsigned char *data,
+                 size_t size);
+
+#endif
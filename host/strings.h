@@ -0,0 +1,6 @@
+#ifndef HOST_STRINGS_H
+#define HOST_STRINGS_H
+// host stand-in for the CS107E strings.h
+#include <string.h>
+
+#endif
@@ -0,0 +1,26 @@
+#include "timer.h"
+#include <time.h>
+
+static unsigned long long now_us(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static unsigned long long start_us;
+
+void timer_init(void) { start_us = now_us(); }
+
+unsigned int timer_get_ticks(void) {
+  if (start_us == 0) {
+    timer_init();
+  }
+  return (unsigned int)(now_us() - start_us);
+}
+
+void timer_delay_us(unsigned int usecs) {
+  struct timespec ts = {usecs / 1000000, (usecs % 1000000) * 1000};
+  nanosleep(&ts, NULL);
+}
+
+void timer_delay_ms(unsigned int msecs) { timer_delay_us(msecs * 1000); }
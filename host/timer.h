@@ -0,0 +1,14 @@
+#ifndef HOST_TIMER_H
+#define HOST_TIMER_H
+// host stand-in for the CS107E timer.h
+// ticks are microseconds since the first call, like the Pi system timer
+
+void timer_init(void);
+
+unsigned int timer_get_ticks(void);
+
+void timer_delay_us(unsigned int usecs);
+
+void timer_delay_ms(unsigned int msecs);
+
+#endif
@@ -0,0 +1,292 @@
+#include "opcodes.h"
+#include "trace.h"
+#include <stdio.h>
+#include <string.h>
+
+// trace decoder: reads a dump printed by trace_dump (captured from the Pi's
+// UART or from bench -t) and prints it as a disassembly listing, oldest
+// instruction first, with what each instruction wrote. anything before the
+// trace header is skipped, so a whole UART log can be fed in
+//
+// usage: tracedump [file]    (default: standard input)
+
+#define LINE_SIZE 256
+
+static const char *const quirk_names[NUM_QUIRKS] = {"chip8", "schip",
+                                                    "xochip"};
+
+// writes the assembly for opcode, as decoded under quirks, to text
+static void disassemble(unsigned short opcode, quirks_t quirks, char *text,
+                        size_t size) {
+  instr_t in = decode_instr(opcode, quirks);
+  int x = in.x, y = in.y, n = in.n, nn = in.nn, nnn = in.nnn;
+  switch ((op_t)in.op) {
+  case OP_0NNN:
+    snprintf(text, size, "SYS  #%03X", nnn);
+    break;
+  case OP_00E0:
+    snprintf(text, size, "CLS");
+    break;
+  case OP_00EE:
+    snprintf(text, size, "RET");
+    break;
+  case OP_00CN:
+    snprintf(text, size, "SCD  %d", n);
+    break;
+  case OP_00DN:
+    snprintf(text, size, "SCU  %d", n);
+    break;
+  case OP_00FB:
+    snprintf(text, size, "SCR");
+    break;
+  case OP_00FC:
+    snprintf(text, size, "SCL");
+    break;
+  case OP_00FD:
+    snprintf(text, size, "EXIT");
+    break;
+  case OP_00FE:
+    snprintf(text, size, "LOW");
+    break;
+  case OP_00FF:
+    snprintf(text, size, "HIGH");
+    break;
+  case OP_1NNN:
+    snprintf(text, size, "JP   #%03X", nnn);
+    break;
+  case OP_2NNN:
+    snprintf(text, size, "CALL #%03X", nnn);
+    break;
+  case OP_3XNN:
+    snprintf(text, size, "SE   V%X, #%02X", x, nn);
+    break;
+  case OP_4XNN:
+    snprintf(text, size, "SNE  V%X, #%02X", x, nn);
+    break;
+  case OP_5XY0:
+    snprintf(text, size, "SE   V%X, V%X", x, y);
+    break;
+  case OP_6XNN:
+    snprintf(text, size, "LD   V%X, #%02X", x, nn);
+    break;
+  case OP_7XNN:
+    snprintf(text, size, "ADD  V%X, #%02X", x, nn);
+    break;
+  case OP_8XY0:
+    snprintf(text, size, "LD   V%X, V%X", x, y);
+    break;
+  case OP_8XY1:
+    snprintf(text, size, "OR   V%X, V%X", x, y);
+    break;
+  case OP_8XY2:
+    snprintf(text, size, "AND  V%X, V%X", x, y);
+    break;
+  case OP_8XY3:
+    snprintf(text, size, "XOR  V%X, V%X", x, y);
+    break;
+  case OP_8XY4:
+    snprintf(text, size, "ADD  V%X, V%X", x, y);
+    break;
+  case OP_8XY5:
+    snprintf(text, size, "SUB  V%X, V%X", x, y);
+    break;
+  case OP_8XY6:
+    snprintf(text, size, "SHR  V%X", x);
+    break;
+  case OP_8XY6_VY:
+    snprintf(text, size, "SHR  V%X, V%X", x, y);
+    break;
+  case OP_8XY7:
+    snprintf(text, size, "SUBN V%X, V%X", x, y);
+    break;
+  case OP_8XYE:
+    snprintf(text, size, "SHL  V%X", x);
+    break;
+  case OP_8XYE_VY:
+    snprintf(text, size, "SHL  V%X, V%X", x, y);
+    break;
+  case OP_9XY0:
+    snprintf(text, size, "SNE  V%X, V%X", x, y);
+    break;
+  case OP_ANNN:
+    snprintf(text, size, "LD   I, #%03X", nnn);
+    break;
+  case OP_BNNN:
+    snprintf(text, size, "JP   V0, #%03X", nnn);
+    break;
+  case OP_BXNN:
+    snprintf(text, size, "JP   V%X, #%03X", x, nnn);
+    break;
+  case OP_CXNN:
+    snprintf(text, size, "RND  V%X, #%02X", x, nn);
+    break;
+  case OP_DXYN:
+    snprintf(text, size, "DRW  V%X, V%X, %d", x, y, n);
+    break;
+  case OP_EX9E:
+    snprintf(text, size, "SKP  V%X", x);
+    break;
+  case OP_EXA1:
+    snprintf(text, size, "SKNP V%X", x);
+    break;
+  case OP_FN01:
+    snprintf(text, size, "PLN  %d", x);
+    break;
+  case OP_F002:
+    snprintf(text, size, "AUDIO");
+    break;
+  case OP_FX07:
+    snprintf(text, size, "LD   V%X, DT", x);
+    break;
+  case OP_FX0A:
+    snprintf(text, size, "LD   V%X, K", x);
+    break;
+  case OP_FX15:
+    snprintf(text, size, "LD   DT, V%X", x);
+    break;
+  case OP_FX18:
+    snprintf(text, size, "LD   ST, V%X", x);
+    break;
+  case OP_FX1E:
+    snprintf(text, size, "ADD  I, V%X", x);
+    break;
+  case OP_FX29:
+    snprintf(text, size, "LD   F, V%X", x);
+    break;
+  case OP_FX30:
+    snprintf(text, size, "LD   HF, V%X", x);
+    break;
+  case OP_FX33:
+    snprintf(text, size, "LD   B, V%X", x);
+    break;
+  case OP_FX3A:
+    snprintf(text, size, "PITCH V%X", x);
+    break;
+  case OP_FX55:
+  case OP_FX55_INC:
+    snprintf(text, size, "LD   [I], V%X", x);
+    break;
+  case OP_FX65:
+  case OP_FX65_INC:
+    snprintf(text, size, "LD   V%X, [I]", x);
+    break;
+  case OP_FX75:
+    snprintf(text, size, "LD   R, V%X", x);
+    break;
+  case OP_FX85:
+    snprintf(text, size, "LD   V%X, R", x);
+    break;
+  default:
+    snprintf(text, size, "DW   #%04X", opcode);
+    break;
+  }
+}
+
+// writes what entry wrote to text; previous is the entry before it, NULL for
+// the oldest, whose I and stack depth are then shown whether or not it
+// changed them
+static void describe_effects(const trace_entry_t *entry,
+                             const trace_entry_t *previous, char *text,
+                             size_t size) {
+  size_t used = 0;
+  text[0] = '\0';
+  int kept = 0;
+  for (int r = 0; r < 16 && used < size; r++) {
+    if (entry->written & (1 << r)) {
+      // registers past the first TRACE_VALUES written have no value kept
+      if (kept < TRACE_VALUES) {
+        used += snprintf(text + used, size - used, " V%X=%02X", r,
+                         entry->values[kept++]);
+      } else {
+        used += snprintf(text + used, size - used, " V%X=?", r);
+      }
+    }
+  }
+  if (used < size && (previous == NULL || entry->i != previous->i)) {
+    used += snprintf(text + used, size - used, " I=%03X", entry->i);
+  }
+  if (used < size && (previous == NULL || entry->sp != previous->sp)) {
+    used += snprintf(text + used, size - used, " SP=%d", entry->sp);
+  }
+  if (used < size && entry->write_len > 0) {
+    used += snprintf(text + used, size - used, " M[%03X..%03X]=",
+                     entry->write_addr,
+                     entry->write_addr + entry->write_len - 1);
+    // as with registers, only the first TRACE_VALUES bytes are kept
+    int kept_bytes =
+        entry->write_len < TRACE_VALUES ? entry->write_len : TRACE_VALUES;
+    for (int b = 0; b < kept_bytes && used < size; b++) {
+      used += snprintf(text + used, size - used, "%02X", entry->values[b]);
+    }
+    if (used < size && entry->write_len > TRACE_VALUES) {
+      used += snprintf(text + used, size - used, "..");
+    }
+  }
+}
+
+int main(int argc, char *argv[]) {
+  FILE *in = stdin;
+  if (argc > 2) {
+    fprintf(stderr, "usage: %s [file]\n", argv[0]);
+    return 1;
+  }
+  if (argc == 2 && (in = fopen(argv[1], "r")) == NULL) {
+    perror(argv[1]);
+    return 1;
+  }
+
+  char line[LINE_SIZE];
+  int version = 0, quirks = 0;
+  unsigned long count = 0;
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (sscanf(line, "trace %d %d %lu", &version, &quirks, &count) == 3) {
+      break;
+    }
+  }
+  if (version != TRACE_VERSION || quirks < 0 || quirks >= NUM_QUIRKS) {
+    fprintf(stderr, "no version %d trace found\n", TRACE_VERSION);
+    return 1;
+  }
+
+  printf("%lu instructions (%s), oldest first\n", count, quirk_names[quirks]);
+  printf("%-4s %-6s %-18s %s\n", "pc", "opcode", "instruction", "writes");
+  trace_entry_t entry, previous;
+  unsigned long read = 0;
+  while (fgets(line, sizeof(line), in) != NULL) {
+    if (strncmp(line, "end", 3) == 0) {
+      break;
+    }
+    unsigned int fields[11];
+    if (sscanf(line, "%4x%4x%4x%4x%2x%2x%2x%2x%4x%2x%2x", &fields[0],
+               &fields[1], &fields[2], &fields[3], &fields[4], &fields[5],
+               &fields[6], &fields[7], &fields[8], &fields[9],
+               &fields[10]) != 11) {
+      fprintf(stderr, "bad trace entry: %s", line);
+      return 1;
+    }
+    entry.pc = fields[0];
+    entry.opcode = fields[1];
+    entry.i = fields[2];
+    entry.written = fields[3];
+    for (int v = 0; v < TRACE_VALUES; v++) {
+      entry.values[v] = fields[4 + v];
+    }
+    entry.write_addr = fields[8];
+    entry.write_len = fields[9];
+    entry.sp = fields[10];
+
+    char instruction[32], effects[128];
+    disassemble(entry.opcode, quirks, instruction, sizeof(instruction));
+    describe_effects(&entry, read > 0 ? &previous : NULL, effects,
+                     sizeof(effects));
+    printf("%03X  %04X   %-18s%s\n", entry.pc, entry.opcode, instruction,
+           effects);
+    previous = entry;
+    read++;
+  }
+  if (read != count) {
+    fprintf(stderr, "trace cut short: %lu of %lu entries\n", read, count);
+    return 1;
+  }
+  return 0;
+}
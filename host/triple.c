@@ -0,0 +1,44 @@
+#include "triple.h"
+#include <string.h>
+
+void triple_init(triple_t *triple) {
+  memset(triple->slots, 0, sizeof(triple->slots));
+  triple->back = 0;
+  triple->middle = 1;
+  triple->front = 2;
+  triple->published = 0;
+  triple->taken = 0;
+}
+
+frame_t *triple_back(triple_t *triple) { return &triple->slots[triple->back]; }
+
+void triple_publish(triple_t *triple) {
+  // release: the frame's contents are visible before the index is
+  unsigned int old = __atomic_exchange_n(
+      &triple->middle, triple->back | TRIPLE_FRESH, __ATOMIC_ACQ_REL);
+  triple->back = old & ~TRIPLE_FRESH;
+  triple->published++;
+}
+
+const frame_t *triple_take(triple_t *triple) {
+  if (!(__atomic_load_n(&triple->middle, __ATOMIC_RELAXED) & TRIPLE_FRESH)) {
+    return NULL;
+  }
+  // acquire: pairs with the release in triple_publish
+  unsigned int old =
+      __atomic_exchange_n(&triple->middle, triple->front, __ATOMIC_ACQ_REL);
+  triple->front = old & ~TRIPLE_FRESH;
+  triple->taken++;
+  return &triple->slots[triple->front];
+}
+
+uint32_t frame_checksum(const frame_t *frame) {
+  // FNV-1a over the words
+  uint32_t hash = 2166136261u;
+  const uint64_t *words = &frame->planes[0][0][0];
+  for (size_t i = 0; i < sizeof(frame->planes) / sizeof(uint64_t); i++) {
+    hash = (hash ^ (uint32_t)words[i]) * 16777619u;
+    hash = (hash ^ (uint32_t)(words[i] >> 32)) * 16777619u;
+  }
+  return hash;
+}
@@ -0,0 +1,55 @@
+#ifndef TRIPLE_H
+#define TRIPLE_H
+// lock-free triple buffer handing finished frames from the emulation thread
+// to a presenter thread
+//
+// of the three slots the writer owns one (back) and the reader one (front);
+// the third sits between them in `middle`. publishing swaps back with middle
+// and marks it fresh, taking swaps front with a fresh middle. each swap is a
+// single atomic exchange, so neither side ever waits for the other: a slow
+// reader only misses frames, and since a slot is never written while the
+// reader holds it, it never sees one half drawn
+
+#include "display.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct {
+  int width;
+  int height;
+  // frames the emulation had run when this one was published
+  unsigned long number;
+  uint64_t planes[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+  // of planes, as written; the reader can check it saw what was written
+  uint32_t checksum;
+} frame_t;
+
+typedef struct {
+  frame_t slots[3];
+  int back;  // writer's slot
+  int front; // reader's slot
+  // slot index between them, | TRIPLE_FRESH once published and not yet
+  // taken; only accessed atomically
+  unsigned int middle;
+  // frames published and taken
+  unsigned long published;
+  unsigned long taken;
+} triple_t;
+
+#define TRIPLE_FRESH 4u
+
+void triple_init(triple_t *triple);
+
+// the slot to draw the next frame into; writer only
+frame_t *triple_back(triple_t *triple);
+
+// hands the back slot to the reader, replacing any frame it has not taken
+void triple_publish(triple_t *triple);
+
+// moves the newest published frame into the reader's slot and returns it, or
+// returns NULL if nothing was published since the last take; reader only
+const frame_t *triple_take(triple_t *triple);
+
+uint32_t frame_checksum(const frame_t *frame);
+
+#endif
@@ -0,0 +1,301 @@
+#include "stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+// display stream viewer: rebuilds the displays of headless machines from
+// their streams (stream.h) and shows them side by side on the terminal, two
+// pixels per character cell
+//
+// usage: view [-l socket] [-c columns] [-d] [stream ...]
+//   -l  listen on a Unix socket and show every machine that connects, as
+//       bench -O unix:socket and batch -O unix:socket do, until interrupted
+//   -c  machines per row (default 2)
+//   -d  show nothing while running; at the end print every machine's final
+//       display as text, as bench -d does, and what its stream cost
+//   stream: a file or FIFO written by bench -O, or - for standard input
+
+#define DEFAULT_COLUMNS 2
+#define MAX_SOURCES 256
+// room for a whole record and the read that completes it
+#define BUFFER_SIZE (2 * STREAM_RECORD_SIZE)
+// redraws per second at most
+#define DRAW_RATE 30
+
+typedef struct {
+  int fd;
+  bool open;
+  unsigned char buffer[BUFFER_SIZE];
+  size_t buffered;
+  stream_reader_t reader;
+} source_t;
+
+static source_t *sources[MAX_SOURCES];
+static int num_sources;
+static int columns = DEFAULT_COLUMNS;
+// set by SIGINT or SIGTERM; the last picture or the dump is still shown
+static volatile sig_atomic_t stopping;
+
+static void stop(int signal) { stopping = 1; }
+
+static double now_seconds(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void add_source(int fd, const char *label) {
+  if (num_sources == MAX_SOURCES) {
+    fprintf(stderr, "too many streams, dropping %s\n", label);
+    close(fd);
+    return;
+  }
+  source_t *source = calloc(1, sizeof(source_t));
+  if (source == NULL) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  source->fd = fd;
+  source->open = true;
+  stream_reader_init(&source->reader);
+  // shown until the stream names its machine
+  snprintf(source->reader.name, sizeof(source->reader.name), "%s", label);
+  sources[num_sources++] = source;
+}
+
+static void close_source(source_t *source) {
+  if (source->fd > STDIN_FILENO) {
+    close(source->fd);
+  }
+  source->open = false;
+}
+
+// reads what fd has and applies every whole record; false once it is closed
+static bool pump(source_t *source) {
+  ssize_t got = read(source->fd, source->buffer + source->buffered,
+                     BUFFER_SIZE - source->buffered);
+  if (got < 0 && (errno == EINTR || errno == EAGAIN)) {
+    return true;
+  }
+  if (got <= 0) {
+    close_source(source);
+    return false;
+  }
+  source->buffered += got;
+  size_t used = 0;
+  for (;;) {
+    long length = stream_read(&source->reader, source->buffer + used,
+                              source->buffered - used);
+    if (length < 0) {
+      fprintf(stderr, "%s: not a display stream\n", source->reader.name);
+      close_source(source);
+      return false;
+    }
+    if (length == 0) {
+      break;
+    }
+    used += length;
+  }
+  memmove(source->buffer, source->buffer + used, source->buffered - used);
+  source->buffered -= used;
+  return true;
+}
+
+static int listen_unix(const char *path) {
+  struct sockaddr_un address = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    fprintf(stderr, "%s: path too long\n", path);
+    return -1;
+  }
+  strcpy(address.sun_path, path);
+  // left behind by an earlier viewer
+  unlink(path);
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 ||
+      bind(fd, (const struct sockaddr *)&address, sizeof(address)) != 0 ||
+      listen(fd, MAX_SOURCES) != 0) {
+    perror(path);
+    return -1;
+  }
+  return fd;
+}
+
+static bool lit(const stream_reader_t *reader, int x, int y) {
+  for (int p = 0; p < DISPLAY_PLANES; p++) {
+    if ((reader->planes[p][y][x / 64] >> (63 - x % 64)) & 1) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// line `line` of a source's panel: a title, then two pixel rows per line
+static void draw_panel_line(const source_t *source, int line) {
+  static const char *const cells[4] = {" ", "▀", "▄", "█"};
+  const stream_reader_t *reader = &source->reader;
+  if (line == 0) {
+    char title[HIRES_WIDTH + 1];
+    snprintf(title, sizeof(title), "%s %lu %lu B%s", reader->name,
+             (unsigned long)reader->update, reader->bytes,
+             source->open ? "" : " (ended)");
+    printf("%-*.*s", reader->width, reader->width, title);
+    return;
+  }
+  int y = (line - 1) * 2;
+  for (int x = 0; x < reader->width; x++) {
+    int cell = 0;
+    if (y < reader->height) {
+      cell = lit(reader, x, y) | lit(reader, x, y + 1) << 1;
+    }
+    fputs(cells[cell], stdout);
+  }
+}
+
+static void draw(void) {
+  // home and overwrite rather than clear, so the picture does not flicker
+  printf("\033[H");
+  for (int first = 0; first < num_sources; first += columns) {
+    int last = first + columns < num_sources ? first + columns : num_sources;
+    int lines = 0;
+    for (int i = first; i < last; i++) {
+      int height = 1 + sources[i]->reader.height / 2;
+      lines = height > lines ? height : lines;
+    }
+    for (int line = 0; line < lines; line++) {
+      for (int i = first; i < last; i++) {
+        draw_panel_line(sources[i], line);
+        printf("  ");
+      }
+      printf("\033[K\n");
+    }
+  }
+  printf("\033[J");
+  fflush(stdout);
+}
+
+static void dump(const source_t *source) {
+  // as headless_dump_display
+  static const char shades[1 << DISPLAY_PLANES] = {'.', '#', '+', '%'};
+  const stream_reader_t *reader = &source->reader;
+  printf("%s: %lu runs, %lu records, %lu bytes\n", reader->name,
+         reader->runs, reader->records, reader->bytes);
+  for (int y = 0; y < reader->height; y++) {
+    for (int x = 0; x < reader->width; x++) {
+      int color = 0;
+      for (int p = 0; p < DISPLAY_PLANES; p++) {
+        color |= ((reader->planes[p][y][x / 64] >> (63 - x % 64)) & 1) << p;
+      }
+      putchar(shades[color]);
+    }
+    putchar('\n');
+  }
+}
+
+int main(int argc, char *argv[]) {
+  const char *socket_path = NULL;
+  bool dumping = false;
+  for (int i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-l") == 0 && i + 1 < argc) {
+      socket_path = argv[++i];
+    } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc) {
+      columns = atoi(argv[++i]);
+      columns = columns < 1 ? 1 : columns;
+    } else if (strcmp(argv[i], "-d") == 0) {
+      dumping = true;
+    } else if (strcmp(argv[i], "-") == 0) {
+      add_source(STDIN_FILENO, "stdin");
+    } else if (argv[i][0] != '-') {
+      int fd = open(argv[i], O_RDONLY);
+      if (fd < 0) {
+        perror(argv[i]);
+        return 1;
+      }
+      add_source(fd, argv[i]);
+    } else {
+      fprintf(stderr,
+              "usage: %s [-l socket] [-c columns] [-d] [stream ...]\n",
+              argv[0]);
+      return 1;
+    }
+  }
+  int listener = -1;
+  if (socket_path != NULL && (listener = listen_unix(socket_path)) < 0) {
+    return 1;
+  }
+  if (listener < 0 && num_sources == 0) {
+    fprintf(stderr, "no streams given\n");
+    return 1;
+  }
+
+  // whole frames go to the terminal in one write
+  setvbuf(stdout, NULL, _IOFBF, 1 << 20);
+  if (!dumping) {
+    printf("\033[2J");
+  }
+  // without SA_RESTART, so a signal also cuts poll short
+  struct sigaction action = {.sa_handler = stop};
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+  double last_draw = 0;
+  bool changed = true;
+  struct pollfd polls[MAX_SOURCES + 1];
+  source_t *polled[MAX_SOURCES + 1];
+  while (!stopping) {
+    int count = 0;
+    if (listener >= 0) {
+      polls[count] = (struct pollfd){.fd = listener, .events = POLLIN};
+      polled[count++] = NULL;
+    }
+    for (int i = 0; i < num_sources; i++) {
+      if (sources[i]->open) {
+        polls[count] = (struct pollfd){.fd = sources[i]->fd, .events = POLLIN};
+        polled[count++] = sources[i];
+      }
+    }
+    if (count == 0) {
+      break;
+    }
+    if (poll(polls, count, 1000 / DRAW_RATE) < 0 && errno != EINTR) {
+      perror("poll");
+      return 1;
+    }
+    for (int i = 0; i < count; i++) {
+      if (!(polls[i].revents & (POLLIN | POLLHUP | POLLERR))) {
+        continue;
+      }
+      if (polled[i] == NULL) {
+        int fd = accept(listener, NULL, NULL);
+        if (fd >= 0) {
+          char label[32];
+          snprintf(label, sizeof(label), "client %d", num_sources);
+          add_source(fd, label);
+        }
+      } else {
+        pump(polled[i]);
+      }
+      changed = true;
+    }
+    double now = now_seconds();
+    if (!dumping && changed && now - last_draw >= 1.0 / DRAW_RATE) {
+      draw();
+      last_draw = now;
+      changed = false;
+    }
+  }
+  if (dumping) {
+    for (int i = 0; i < num_sources; i++) {
+      dump(sources[i]);
+    }
+  } else {
+    draw();
+  }
+  return 0;
+}
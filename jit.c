@@ -0,0 +1,711 @@
+#include "jit.h"
+#include "dispatch.h"
+#include "exec.h"
+#include "predecode.h"
+#include "strings.h"
+
+#if defined(__x86_64__) || defined(__arm__)
+#define JIT_NATIVE
+#endif
+
+#ifdef JIT_NATIVE
+
+typedef void (*handler_t)(chip_t *chip, const instr_t *in);
+
+#define OP_HANDLER(name) [OP_##name] = exec_##name,
+static const handler_t handlers[NUM_OPS] = {OPCODE_LIST(OP_HANDLER)};
+#undef OP_HANDLER
+
+// the glue's entry point, at jit->enter_at: runs blocks from PC on until one
+// needs more than count instructions or there is none, and returns the count
+// left
+typedef unsigned int (*enter_t)(chip_t *chip, unsigned int count,
+                                void *const *entry);
+
+// conditions a jump can be taken on, after emit_compare_count,
+// emit_test_skip or emit_compare_pc; BELOW and NOT_BELOW are unsigned
+typedef enum {
+  COND_ALWAYS,
+  COND_EQ,
+  COND_NE,
+  COND_BELOW,
+  COND_NOT_BELOW
+} cond_t;
+
+#define V_AT offsetof(chip_t, V)
+#define I_AT offsetof(chip_t, I)
+#define PC_AT offsetof(chip_t, PC)
+
+static void put8(jit_t *jit, unsigned int byte) {
+  jit->code[jit->used++] = byte;
+}
+
+static void put32(jit_t *jit, uint32_t word) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    put8(jit, word >> shift);
+  }
+}
+
+static void write32(jit_t *jit, unsigned int at, uint32_t word) {
+  for (int shift = 0; shift < 32; shift += 8) {
+    jit->code[at++] = word >> shift;
+  }
+}
+
+#endif
+
+#if defined(__x86_64__)
+
+// rbx holds the chip, r12d the instructions left and r13 jit->entry, all
+// kept across calls; everything else is scratch. the glue pushes three
+// registers, which leaves the stack aligned for calls from the blocks
+
+static const unsigned char x86_conds[] = {[COND_EQ] = 0x84,
+                                          [COND_NE] = 0x85,
+                                          [COND_BELOW] = 0x82,
+                                          [COND_NOT_BELOW] = 0x83};
+
+// an opcode byte, then a ModRM for [rbx + disp32] with reg and the disp32
+static void x86_rbx(jit_t *jit, unsigned int opcode, unsigned int reg,
+                    unsigned int disp) {
+  put8(jit, opcode);
+  put8(jit, 0x83 | reg << 3);
+  put32(jit, disp);
+}
+
+static void patch_branch(jit_t *jit, unsigned int site, const void *target) {
+  write32(jit, site, (const unsigned char *)target - (jit->code + site + 4));
+}
+
+// a jump to target, or to be patched later if NULL; returns the offset of
+// its rel32
+static unsigned int emit_branch(jit_t *jit, cond_t cond, const void *target) {
+  if (cond == COND_ALWAYS) {
+    put8(jit, 0xE9);
+  } else {
+    put8(jit, 0x0F);
+    put8(jit, x86_conds[cond]);
+  }
+  unsigned int site = jit->used;
+  put32(jit, 0);
+  if (target != NULL) {
+    patch_branch(jit, site, target);
+  }
+  return site;
+}
+
+static void emit_glue(jit_t *jit) {
+  // exit: mov eax, r12d; pop r13; pop r12; pop rbx; ret
+  jit->exit_at = jit->used;
+  static const unsigned char exit[] = {0x44, 0x89, 0xE0, 0x41, 0x5D,
+                                       0x41, 0x5C, 0x5B, 0xC3};
+  for (unsigned int i = 0; i < sizeof(exit); i++) {
+    put8(jit, exit[i]);
+  }
+  // dispatch: movzx eax, word [rbx + PC]; cmp eax, MEM_SIZE; jae exit;
+  // mov rax, [r13 + rax * 8]; test rax, rax; jz exit; jmp rax
+  jit->dispatch_at = jit->used;
+  put8(jit, 0x0F);
+  x86_rbx(jit, 0xB7, 0, PC_AT);
+  put8(jit, 0x3D);
+  put32(jit, MEM_SIZE);
+  emit_branch(jit, COND_NOT_BELOW, jit->code + jit->exit_at);
+  static const unsigned char lookup[] = {0x49, 0x8B, 0x44, 0xC5,
+                                         0x00, 0x48, 0x85, 0xC0};
+  for (unsigned int i = 0; i < sizeof(lookup); i++) {
+    put8(jit, lookup[i]);
+  }
+  emit_branch(jit, COND_EQ, jit->code + jit->exit_at);
+  put8(jit, 0xFF);
+  put8(jit, 0xE0);
+  // enter: push rbx; push r12; push r13; mov rbx, rdi; mov r12d, esi;
+  // mov r13, rdx; then dispatch
+  jit->enter_at = jit->used;
+  static const unsigned char enter[] = {0x53, 0x41, 0x54, 0x41, 0x55,
+                                        0x48, 0x89, 0xFB, 0x41, 0x89,
+                                        0xF4, 0x49, 0x89, 0xD5};
+  for (unsigned int i = 0; i < sizeof(enter); i++) {
+    put8(jit, enter[i]);
+  }
+  emit_branch(jit, COND_ALWAYS, jit->code + jit->dispatch_at);
+}
+
+static void emit_compare_count(jit_t *jit, unsigned int count) {
+  // cmp r12d, imm32
+  put8(jit, 0x41);
+  put8(jit, 0x81);
+  put8(jit, 0xFC);
+  put32(jit, count);
+}
+
+static void emit_sub_count(jit_t *jit, unsigned int count) {
+  // sub r12d, imm32
+  put8(jit, 0x41);
+  put8(jit, 0x81);
+  put8(jit, 0xEC);
+  put32(jit, count);
+}
+
+static void emit_set_pc(jit_t *jit, unsigned int pc) {
+  // mov word [rbx + PC], imm16
+  put8(jit, 0x66);
+  x86_rbx(jit, 0xC7, 0, PC_AT);
+  put8(jit, pc);
+  put8(jit, pc >> 8);
+}
+
+static void emit_compare_pc(jit_t *jit, unsigned int pc) {
+  // cmp word [rbx + PC], imm16
+  put8(jit, 0x66);
+  x86_rbx(jit, 0x81, 7, PC_AT);
+  put8(jit, pc);
+  put8(jit, pc >> 8);
+}
+
+static bool emit_inline(jit_t *jit, const instr_t *in) {
+  switch (in->op) {
+  case OP_6XNN:
+    // mov byte [V + x], nn
+    x86_rbx(jit, 0xC6, 0, V_AT + in->x);
+    put8(jit, in->nn);
+    return true;
+  case OP_7XNN:
+    // add byte [V + x], nn
+    x86_rbx(jit, 0x80, 0, V_AT + in->x);
+    put8(jit, in->nn);
+    return true;
+  case OP_8XY0:
+  case OP_8XY1:
+  case OP_8XY2:
+  case OP_8XY3: {
+    // mov al, [V + y]; then mov, or, and or xor [V + x], al
+    static const unsigned char ops[] = {0x88, 0x08, 0x20, 0x30};
+    x86_rbx(jit, 0x8A, 0, V_AT + in->y);
+    x86_rbx(jit, ops[in->op - OP_8XY0], 0, V_AT + in->x);
+    return true;
+  }
+  case OP_ANNN:
+    // mov word [rbx + I], nnn
+    put8(jit, 0x66);
+    x86_rbx(jit, 0xC7, 0, I_AT);
+    put8(jit, in->nnn);
+    put8(jit, in->nnn >> 8);
+    return true;
+  }
+  return false;
+}
+
+// for 3XNN, 4XNN, 5XY0 and 9XY0; returns the condition the skip is taken on
+static cond_t emit_test_skip(jit_t *jit, const instr_t *in) {
+  if (in->op == OP_3XNN || in->op == OP_4XNN) {
+    // cmp byte [V + x], nn
+    x86_rbx(jit, 0x80, 7, V_AT + in->x);
+    put8(jit, in->nn);
+  } else {
+    // mov al, [V + x]; cmp al, [V + y]
+    x86_rbx(jit, 0x8A, 0, V_AT + in->x);
+    x86_rbx(jit, 0x3A, 0, V_AT + in->y);
+  }
+  return in->op == OP_3XNN || in->op == OP_5XY0 ? COND_EQ : COND_NE;
+}
+
+static void emit_call(jit_t *jit, const instr_t *in) {
+  // mov rdi, rbx; mov rsi, in; mov rax, handler; call rax
+  uint64_t args[2] = {(uintptr_t)in, (uintptr_t)handlers[in->op]};
+  put8(jit, 0x48);
+  put8(jit, 0x89);
+  put8(jit, 0xDF);
+  for (int a = 0; a < 2; a++) {
+    put8(jit, 0x48);
+    put8(jit, a == 0 ? 0xBE : 0xB8);
+    put32(jit, args[a]);
+    put32(jit, args[a] >> 32);
+  }
+  put8(jit, 0xFF);
+  put8(jit, 0xD0);
+}
+
+// instruction and data caches are coherent on x86
+static void sync_code(jit_t *jit) {}
+
+#elif defined(__arm__)
+
+// ARMv6, no Thumb. r4 holds the chip, r5 the instructions left, r6 &chip->V
+// (MEM puts V beyond the reach of a load offset from the chip) and r7
+// jit->entry, all kept across calls; r0, r1 and r12 are scratch. the glue
+// pushes six registers, which keeps the stack 8-byte aligned for calls
+
+#define R0 0
+#define R1 1
+#define CHIP 4
+#define COUNT 5
+#define REGS 6
+#define ENTRY 7
+#define R12 12
+
+static const unsigned char arm_conds[] = {[COND_ALWAYS] = 0xE,
+                                          [COND_EQ] = 0x0,
+                                          [COND_NE] = 0x1,
+                                          [COND_BELOW] = 0x3,
+                                          [COND_NOT_BELOW] = 0x2};
+
+static void arm(jit_t *jit, uint32_t word) { put32(jit, word); }
+
+// data processing with an immediate: op is the opcode field, value must fit
+// in 8 bits rotated right by an even amount
+static void arm_imm(jit_t *jit, unsigned int op, int rd, int rn,
+                    uint32_t value) {
+  int rotate = 0;
+  while (value > 0xFF && rotate < 16) {
+    value = value << 2 | value >> 30;
+    rotate++;
+  }
+  arm(jit, 0xE2000000 | op << 21 | (op >= 8 && op <= 11) << 20 | rn << 16 |
+               rd << 12 | rotate << 8 | value);
+}
+
+#define ARM_AND 0x0
+#define ARM_EOR 0x1
+#define ARM_SUB 0x2
+#define ARM_ADD 0x4
+#define ARM_CMP 0xA
+#define ARM_ORR 0xC
+#define ARM_MOV 0xD
+
+// rd = value, any 16-bit value
+static void arm_mov16(jit_t *jit, int rd, unsigned int value) {
+  arm_imm(jit, ARM_MOV, rd, 0, value & 0xFF);
+  if (value > 0xFF) {
+    arm_imm(jit, ARM_ORR, rd, rd, value & 0xFF00);
+  }
+}
+
+// ldrb/strb rt, [REGS, #offset]
+static void arm_ldrb(jit_t *jit, int rt, unsigned int offset) {
+  arm(jit, 0xE5D00000 | REGS << 16 | rt << 12 | offset);
+}
+
+static void arm_strb(jit_t *jit, int rt, unsigned int offset) {
+  arm(jit, 0xE5C00000 | REGS << 16 | rt << 12 | offset);
+}
+
+// ldrh/strh rt, [REGS, #offset], offset below 256
+static void arm_ldrh(jit_t *jit, int rt, unsigned int offset) {
+  arm(jit, 0xE1D000B0 | REGS << 16 | rt << 12 | (offset & 0xF0) << 4 |
+               (offset & 0xF));
+}
+
+static void arm_strh(jit_t *jit, int rt, unsigned int offset) {
+  arm(jit, 0xE1C000B0 | REGS << 16 | rt << 12 | (offset & 0xF0) << 4 |
+               (offset & 0xF));
+}
+
+static void patch_branch(jit_t *jit, unsigned int site, const void *target) {
+  int32_t offset =
+      ((const unsigned char *)target - (jit->code + site + 8)) >> 2;
+  uint32_t cond = (uint32_t)jit->code[site + 3] << 24;
+  write32(jit, site, cond | (offset & 0x00FFFFFF));
+}
+
+// a jump to target, or to be patched later if NULL; returns the offset of
+// the instruction
+static unsigned int emit_branch(jit_t *jit, cond_t cond, const void *target) {
+  unsigned int site = jit->used;
+  arm(jit, (uint32_t)arm_conds[cond] << 28 | 0x0A000000);
+  if (target != NULL) {
+    patch_branch(jit, site, target);
+  }
+  return site;
+}
+
+static void emit_glue(jit_t *jit) {
+  // exit: mov r0, r5; pop {r4-r8, pc}
+  jit->exit_at = jit->used;
+  arm(jit, 0xE1A00000 | R0 << 12 | COUNT);
+  arm(jit, 0xE8BD81F0);
+  // dispatch: ldrh r0, [REGS, #PC]; cmp r0, #MEM_SIZE; bhs exit;
+  // ldr r0, [ENTRY, r0, lsl #2]; cmp r0, #0; bxne r0; b exit
+  jit->dispatch_at = jit->used;
+  arm_ldrh(jit, R0, PC_AT - V_AT);
+  arm_imm(jit, ARM_CMP, 0, R0, MEM_SIZE);
+  emit_branch(jit, COND_NOT_BELOW, jit->code + jit->exit_at);
+  arm(jit, 0xE7900100 | ENTRY << 16 | R0 << 12 | R0);
+  arm_imm(jit, ARM_CMP, 0, R0, 0);
+  arm(jit, 0x112FFF10 | R0);
+  emit_branch(jit, COND_ALWAYS, jit->code + jit->exit_at);
+  // enter: push {r4-r8, lr}; mov r4, r0; mov r5, r1; mov r7, r2;
+  // add r6, r4, #V; then dispatch
+  jit->enter_at = jit->used;
+  arm(jit, 0xE92D41F0);
+  arm(jit, 0xE1A00000 | CHIP << 12 | R0);
+  arm(jit, 0xE1A00000 | COUNT << 12 | R1);
+  arm(jit, 0xE1A00000 | ENTRY << 12 | 2);
+  arm_imm(jit, ARM_ADD, REGS, CHIP, V_AT & 0xFF00);
+  if (V_AT & 0xFF) {
+    arm_imm(jit, ARM_ADD, REGS, REGS, V_AT & 0xFF);
+  }
+  emit_branch(jit, COND_ALWAYS, jit->code + jit->dispatch_at);
+}
+
+static void emit_compare_count(jit_t *jit, unsigned int count) {
+  arm_imm(jit, ARM_CMP, 0, COUNT, count);
+}
+
+static void emit_sub_count(jit_t *jit, unsigned int count) {
+  arm_imm(jit, ARM_SUB, COUNT, COUNT, count);
+}
+
+static void emit_set_pc(jit_t *jit, unsigned int pc) {
+  arm_mov16(jit, R0, pc);
+  arm_strh(jit, R0, PC_AT - V_AT);
+}
+
+static void emit_compare_pc(jit_t *jit, unsigned int pc) {
+  arm_ldrh(jit, R0, PC_AT - V_AT);
+  arm_mov16(jit, R1, pc);
+  // cmp r0, r1
+  arm(jit, 0xE1500000 | R0 << 16 | R1);
+}
+
+static bool emit_inline(jit_t *jit, const instr_t *in) {
+  switch (in->op) {
+  case OP_6XNN:
+    arm_imm(jit, ARM_MOV, R0, 0, in->nn);
+    arm_strb(jit, R0, in->x);
+    return true;
+  case OP_7XNN:
+    arm_ldrb(jit, R0, in->x);
+    arm_imm(jit, ARM_ADD, R0, R0, in->nn);
+    arm_strb(jit, R0, in->x);
+    return true;
+  case OP_8XY0:
+    arm_ldrb(jit, R0, in->y);
+    arm_strb(jit, R0, in->x);
+    return true;
+  case OP_8XY1:
+  case OP_8XY2:
+  case OP_8XY3: {
+    static const unsigned char ops[] = {ARM_ORR, ARM_AND, ARM_EOR};
+    arm_ldrb(jit, R0, in->x);
+    arm_ldrb(jit, R1, in->y);
+    // op r0, r0, r1
+    arm(jit, 0xE0000000 | ops[in->op - OP_8XY1] << 21 | R0 << 16 | R0 << 12 |
+                 R1);
+    arm_strb(jit, R0, in->x);
+    return true;
+  }
+  case OP_ANNN:
+    arm_mov16(jit, R0, in->nnn);
+    arm_strh(jit, R0, I_AT - V_AT);
+    return true;
+  }
+  return false;
+}
+
+// for 3XNN, 4XNN, 5XY0 and 9XY0; returns the condition the skip is taken on
+static cond_t emit_test_skip(jit_t *jit, const instr_t *in) {
+  arm_ldrb(jit, R0, in->x);
+  if (in->op == OP_3XNN || in->op == OP_4XNN) {
+    arm_imm(jit, ARM_CMP, 0, R0, in->nn);
+  } else {
+    arm_ldrb(jit, R1, in->y);
+    arm(jit, 0xE1500000 | R0 << 16 | R1);
+  }
+  return in->op == OP_3XNN || in->op == OP_5XY0 ? COND_EQ : COND_NE;
+}
+
+static void emit_call(jit_t *jit, const instr_t *in) {
+  // ldr r1, [pc, #4]; ldr r12, [pc, #4]; b over the two words; in; handler;
+  // mov r0, r4; blx r12
+  arm(jit, 0xE59F0004 | R1 << 12);
+  arm(jit, 0xE59F0004 | R12 << 12);
+  arm(jit, 0xEA000001);
+  arm(jit, (uintptr_t)in);
+  arm(jit, (uintptr_t)handlers[in->op]);
+  arm(jit, 0xE1A00000 | R0 << 12 | CHIP);
+  arm(jit, 0xE12FFF30 | R12);
+}
+
+// the code was written through the data side: clean it out of the data
+// cache and the write buffer, then drop stale instructions and branch
+// predictions (ARM1176 cache operations)
+static void sync_code(jit_t *jit) {
+  unsigned int zero = 0;
+  __asm__ volatile("mcr p15, 0, %0, c7, c10, 0\n"
+                   "mcr p15, 0, %0, c7, c10, 4\n"
+                   "mcr p15, 0, %0, c7, c5, 0\n"
+                   "mcr p15, 0, %0, c7, c5, 6\n"
+                   "mcr p15, 0, %0, c7, c5, 4\n"
+                   :
+                   : "r"(zero)
+                   : "memory");
+}
+
+#endif
+
+#ifdef JIT_NATIVE
+
+// jumps out of the block being translated that go to a stub after it, which
+// sets PC and goes on to the glue
+typedef struct {
+  unsigned int site;
+  unsigned int pc;
+  // the budget check: its stub leaves for C even if there is a block at pc
+  bool exit;
+} pending_t;
+
+// the budget check and at most two jumps on
+static pending_t pending[3];
+static int num_pending;
+
+// instructions after which a block ends
+static bool ends_block(unsigned char op) {
+  switch (op) {
+  case OP_00EE:
+  case OP_00FD:
+  case OP_1NNN:
+  case OP_2NNN:
+  case OP_3XNN:
+  case OP_4XNN:
+  case OP_5XY0:
+  case OP_9XY0:
+  case OP_BNNN:
+  case OP_BXNN:
+  case OP_EX9E:
+  case OP_EXA1:
+  case OP_FX0A:
+  // may write into code, which only dispatch takes notice of
+  case OP_FX33:
+  case OP_FX55:
+  case OP_FX55_INC:
+    return true;
+  }
+  return false;
+}
+
+// a jump to the block at pc, taken on cond; until there is one, it goes to
+// a stub that looks pc up and is patched once the block is translated
+static void emit_goto(jit_t *jit, cond_t cond, unsigned int pc) {
+  if (pc < MEM_SIZE && jit->entry[pc] != NULL) {
+    emit_branch(jit, cond, jit->entry[pc]);
+    return;
+  }
+  unsigned int site = emit_branch(jit, cond, NULL);
+  pending[num_pending++] = (pending_t){site, pc, false};
+}
+
+static void drop_blocks(jit_t *jit) {
+  jit->used = jit->glue_size;
+  memset(jit->entry, 0, sizeof(jit->entry));
+  memset(jit->covered, 0, sizeof(jit->covered));
+  jit->num_links = 0;
+  jit->flushes++;
+}
+
+// the instructions of the block at start, copied to jit->instrs; returns
+// how many
+static int find_block(chip_t *chip, jit_t *jit, unsigned int start) {
+  int len = 0;
+  for (unsigned int addr = start; len < JIT_MAX_BLOCK && addr + 1 < MEM_SIZE;
+       addr += 2) {
+    if (jit->written[addr] || jit->written[addr + 1]) {
+      break;
+    }
+    if (chip->PREDECODED[addr].op == OP_STALE) {
+      predecode(chip, addr);
+    }
+    const instr_t *in = &chip->PREDECODED[addr];
+    jit->instrs[addr] = *in;
+    len++;
+    if (ends_block(in->op)) {
+      break;
+    }
+  }
+  return len;
+}
+
+static void emit_body(jit_t *jit, const instr_t *in) {
+  // no-ops in the interpreter as well
+  if (in->op == OP_UNKNOWN || in->op == OP_0NNN) {
+    return;
+  }
+  if (!emit_inline(jit, in)) {
+    emit_call(jit, in);
+  }
+}
+
+// translates the block at start; false if it has no instruction to
+// translate
+static bool translate(chip_t *chip, jit_t *jit, unsigned int start) {
+  if (jit->used + JIT_MAX_BLOCK_CODE > jit->code_size) {
+    drop_blocks(jit);
+  }
+  int len = find_block(chip, jit, start);
+  if (len == 0) {
+    return false;
+  }
+  unsigned int from = jit->used;
+  num_pending = 0;
+  emit_compare_count(jit, len);
+  pending[num_pending++] =
+      (pending_t){emit_branch(jit, COND_BELOW, NULL), start, true};
+  emit_sub_count(jit, len);
+
+  unsigned int end = start + 2 * len;
+  for (unsigned int addr = start; addr < end - 2; addr += 2) {
+    emit_body(jit, &jit->instrs[addr]);
+  }
+  const instr_t *last = &jit->instrs[end - 2];
+  switch (last->op) {
+  case OP_1NNN:
+    emit_goto(jit, COND_ALWAYS, last->nnn);
+    break;
+  case OP_2NNN:
+    emit_set_pc(jit, end);
+    emit_call(jit, last);
+    emit_goto(jit, COND_ALWAYS, last->nnn);
+    break;
+  case OP_3XNN:
+  case OP_4XNN:
+  case OP_5XY0:
+  case OP_9XY0:
+    emit_goto(jit, emit_test_skip(jit, last), end + 2);
+    emit_goto(jit, COND_ALWAYS, end);
+    break;
+  case OP_EX9E:
+  case OP_EXA1:
+    emit_set_pc(jit, end);
+    emit_call(jit, last);
+    emit_compare_pc(jit, end + 2);
+    emit_goto(jit, COND_EQ, end + 2);
+    emit_goto(jit, COND_ALWAYS, end);
+    break;
+  case OP_00EE:
+  case OP_00FD:
+  case OP_BNNN:
+  case OP_BXNN:
+  case OP_FX0A:
+  case OP_FX33:
+  case OP_FX55:
+  case OP_FX55_INC:
+    // the next block depends on what the instruction did (FX0A without a
+    // key goes back to itself), or a write may have dropped every block
+    emit_set_pc(jit, end);
+    emit_call(jit, last);
+    emit_branch(jit, COND_ALWAYS, jit->code + jit->dispatch_at);
+    break;
+  default:
+    emit_body(jit, last);
+    emit_goto(jit, COND_ALWAYS, end);
+    break;
+  }
+
+  for (int p = 0; p < num_pending; p++) {
+    patch_branch(jit, pending[p].site, jit->code + jit->used);
+    emit_set_pc(jit, pending[p].pc);
+    unsigned int glue = pending[p].exit ? jit->exit_at : jit->dispatch_at;
+    emit_branch(jit, COND_ALWAYS, jit->code + glue);
+    // past the end of memory there is never a block
+    if (!pending[p].exit && pending[p].pc < MEM_SIZE &&
+        jit->num_links < JIT_MAX_LINKS) {
+      jit->links[jit->num_links++] =
+          (jit_link_t){pending[p].site, pending[p].pc};
+    }
+  }
+
+  jit->entry[start] = jit->code + from;
+  for (unsigned int addr = start; addr < end; addr++) {
+    jit->covered[addr] = true;
+  }
+  // jumps already translated to here no longer leave
+  for (int l = 0; l < jit->num_links;) {
+    if (jit->links[l].target == start) {
+      patch_branch(jit, jit->links[l].site, jit->entry[start]);
+      jit->links[l] = jit->links[--jit->num_links];
+    } else {
+      l++;
+    }
+  }
+  sync_code(jit);
+  jit->translated++;
+  return true;
+}
+
+void jit_init(jit_t *jit, unsigned char *code, unsigned int size) {
+  jit->code = code;
+  jit->code_size = size;
+  jit->used = 0;
+  emit_glue(jit);
+  jit->glue_size = jit->used;
+  memset(jit->written, 0, sizeof(jit->written));
+  drop_blocks(jit);
+  jit->translated = 0;
+  jit->flushes = 0;
+  sync_code(jit);
+}
+
+void jit_run(chip_t *chip, unsigned int count) {
+  jit_t *jit = chip->TRANSLATED;
+  if (jit == NULL) {
+    dispatch_table(chip, count);
+    return;
+  }
+  enter_t enter = (enter_t)(void *)(jit->code + jit->enter_at);
+  while (count > 0) {
+    count = enter(chip, count, jit->entry);
+    if (count == 0) {
+      break;
+    }
+    // the blocks stopped at PC: the block there needs more instructions
+    // than are left, or there is none yet
+    unsigned int pc = chip->PC;
+    if (pc < MEM_SIZE && jit->entry[pc] != NULL) {
+      dispatch_table(chip, count);
+      break;
+    }
+    if (pc >= MEM_SIZE || !translate(chip, jit, pc)) {
+      dispatch_table(chip, 1);
+      count--;
+    }
+  }
+}
+
+void jit_reset(chip_t *chip) {
+  jit_t *jit = chip->TRANSLATED;
+  if (jit == NULL) {
+    return;
+  }
+  drop_blocks(jit);
+  memset(jit->written, 0, sizeof(jit->written));
+  jit->translated = 0;
+  jit->flushes = 0;
+}
+
+void jit_invalidate(chip_t *chip, unsigned short addr) {
+  chip->TRANSLATED->written[addr] = true;
+  drop_blocks(chip->TRANSLATED);
+}
+
+#else
+
+// no machine code for this processor: nothing is translated and jit_run is
+// the table engine
+
+void jit_init(jit_t *jit, unsigned char *code, unsigned int size) {
+  jit->code = code;
+  jit->code_size = size;
+  jit->used = 0;
+  jit->translated = 0;
+  jit->flushes = 0;
+  memset(jit->covered, 0, sizeof(jit->covered));
+}
+
+void jit_run(chip_t *chip, unsigned int count) {
+  dispatch_table(chip, count);
+}
+
+void jit_reset(chip_t *chip) {}
+
+void jit_invalidate(chip_t *chip, unsigned short addr) {}
+
+#endif
@@ -0,0 +1,83 @@
+#ifndef JIT_H
+#define JIT_H
+// run-time translation of CHIP-8 code into host machine code
+//
+// jit_run looks up the block starting at PC in a cache by address and, the
+// first time it gets there, translates the block: the instructions from PC
+// up to a jump, call, return, skip, key wait or memory write, at most
+// JIT_MAX_BLOCK of them. the common register ops (6XNN, 7XNN, 8XY0-8XY3,
+// ANNN) and the skips that compare registers become machine instructions;
+// the others call the exec_ functions in exec.h, so DXYN, timers, keys and
+// the rest run the interpreter's code. a block ends by jumping straight to
+// the block its 1NNN, 2NNN or skip leads to, patched in once that block
+// exists; returns, computed jumps and FX0A look the next block up by PC from
+// machine code, and only a missing block goes back to C. a write to the
+// bytes of a block drops every block, since blocks jump into each other,
+// and the written bytes are left to the interpreter from then on while the
+// code around them is translated again
+//
+// the code is x86-64 on the host and ARM on the Pi; elsewhere jit_run runs
+// the table engine. it is opt-in: bench -e jit on the host, make JIT=1 on
+// the Pi
+
+#include "hachip.h"
+#include "opcodes.h"
+#include <stdbool.h>
+
+// instructions per block at most; a longer run is split
+#define JIT_MAX_BLOCK 64
+// machine code one block can take, with room to spare
+#define JIT_MAX_BLOCK_CODE 4096
+// bytes to give jit_init; filling them drops every block
+#define JIT_CODE_SIZE (256 * 1024)
+// jumps waiting for their target to be translated
+#define JIT_MAX_LINKS 1024
+
+typedef struct {
+  // offset in the code of the jump to patch
+  unsigned int site;
+  unsigned short target;
+} jit_link_t;
+
+typedef struct jit {
+  // executable memory for the translated blocks, filled from the start;
+  // the first glue_size bytes hold the glue between C and the blocks: where
+  // C enters it, where blocks look the next block up by PC and where they
+  // leave back to C
+  unsigned char *code;
+  unsigned int code_size;
+  unsigned int used;
+  unsigned int glue_size;
+  unsigned int enter_at, dispatch_at, exit_at;
+  // machine code of the block starting at each address, NULL if none
+  void *entry[MEM_SIZE];
+  // bytes of the translated blocks; write_mem reports writes to them to
+  // jit_invalidate
+  bool covered[MEM_SIZE];
+  // bytes written since they were translated, left to the interpreter
+  bool written[MEM_SIZE];
+  // the instructions translated, for the exec_ functions the blocks call
+  instr_t instrs[MEM_SIZE];
+  jit_link_t links[JIT_MAX_LINKS];
+  int num_links;
+  // blocks translated and times every block was dropped, for bench
+  unsigned long translated;
+  unsigned long flushes;
+} jit_t;
+
+// prepares jit to translate into code, size bytes of memory the processor
+// can execute; a chip runs translated code once its TRANSLATED points to jit
+void jit_init(jit_t *jit, unsigned char *code, unsigned int size);
+
+// runs count instructions starting at PC, translating blocks as needed
+void jit_run(chip_t *chip, unsigned int count);
+
+// drops every block and what has been written; called whenever memory is
+// replaced wholesale. does nothing for a chip without chip->TRANSLATED
+void jit_reset(chip_t *chip);
+
+// drops every block, and leaves addr to the interpreter from now on; called
+// by write_mem for bytes marked in chip->TRANSLATED->covered
+void jit_invalidate(chip_t *chip, unsigned short addr);
+
+#endif
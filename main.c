@@ -0,0 +1,143 @@
+#include "aot.h"
+#include "hachip.h"
+#include "jit.h"
+#include "peripherals.h"
+#include "printf.h"
+#include "profile.h"
+#include "replay.h"
+#include "rewind.h"
+#include "roms.h"
+#include "scheduler.h"
+#include "strings.h"
+#include "timer.h"
+#include "trace.h"
+
+#define INSTRUCTIONS_PER_FRAME DEFAULT_INSTRUCTIONS_PER_FRAME
+static chip_t chip;
+static scheduler_t sched;
+static rewind_t history;
+// input of the running program, printed over the UART when F2 is pressed and
+// replayable on the host with bench -I
+static replay_t recording;
+// last instructions run, printed over the UART when F3 is pressed or an
+// assert fails
+static trace_t trace;
+#ifdef PROFILING
+static profile_t profile;
+#endif
+#ifdef JIT
+// the translated blocks and the memory they are written to, as words so the
+// code is aligned
+static jit_t jit;
+static uint32_t jit_code[JIT_CODE_SIZE / 4];
+#endif
+
+// lists the built-in ROMs and waits for the key of one of them; only the
+// first 16 have a key
+static const rom_t *choose_rom(void) {
+  const char *names[16];
+  int count = NUM_ROMS < 16 ? NUM_ROMS : 16;
+  for (int i = 0; i < count; i++) {
+    names[i] = ROMS[i].name;
+  }
+  show_menu(names, count);
+  bool keypad[16] = {false};
+  while (true) {
+    fill_audio();
+    set_keys(keypad);
+    for (int i = 0; i < count; i++) {
+      if (keypad[i]) {
+        // escape pressed while the menu was up has nothing to go back to
+        menu_requested();
+        return &ROMS[i];
+      }
+    }
+  }
+}
+
+static void start_rom(const rom_t *rom) {
+  uint32_t seed = timer_get_ticks();
+  init_chip(&chip, &PERIPHERALS_IO);
+#ifdef JIT
+  chip.TRANSLATED = &jit;
+#endif
+  seed_random(&chip, seed);
+  load_program(&chip, rom->data, rom->size, rom->quirks);
+  scheduler_init(&sched, &chip, INSTRUCTIONS_PER_FRAME);
+  replay_init(&recording, rom->name, rom->quirks, seed,
+              INSTRUCTIONS_PER_FRAME);
+  sched.replay = &recording;
+  sched.wait = sleep_us;
+  rewind_init(&history);
+  trace_reset(&trace);
+  chip.TRACE = &trace;
+#ifdef PROFILING
+  // counters go out over the UART when F1 is pressed; the profiler takes the
+  // place of the tracing engine, so the trace stays empty
+  profile_reset(&profile);
+  chip.PROFILE = &profile;
+  sched.run = profile_run;
+#elif defined(AOT)
+  // the built-in ROMs run as compiled blocks (aot.h); like the profiler it
+  // takes the place of the tracing engine
+  sched.run = aot_run;
+#elif defined(JIT)
+  // any ROM runs as blocks translated when first reached (jit.h), again in
+  // place of the tracing engine
+  sched.run = jit_run;
+#else
+  sched.run = trace_run;
+#endif
+}
+
+int main() {
+  init_keyboard();
+  init_display(DISPLAY_WIDTH, DISPLAY_HEIGHT);
+  init_audio();
+#ifdef JIT
+  jit_init(&jit, (unsigned char *)jit_code, sizeof(jit_code));
+#endif
+  start_rom(choose_rom());
+  while (true) {
+    // between frames, so making samples never holds up the program
+    fill_audio();
+    if (report_requested()) {
+      printf("audio: %lu underruns\n", audio_underruns());
+#ifdef PROFILING
+      profile_print(&profile);
+#endif
+    }
+    if (log_requested()) {
+      replay_print(&recording);
+    }
+    if (trace_requested()) {
+      trace_dump(&chip);
+    }
+    if (turbo_requested()) {
+      sched.turbo = !sched.turbo;
+    }
+    if (menu_requested()) {
+      start_rom(choose_rom());
+    }
+    if (rewind_held()) {
+      // play the recorded frames backwards at the normal frame rate; the
+      // keypad keeps following the keys actually held
+      bool keypad[16];
+      chip.IO->set_keys(&chip, chip.KEYPAD);
+      memcpy(keypad, chip.KEYPAD, sizeof(keypad));
+      if (rewind_step(&history, &chip)) {
+        // the frames stepped over are no longer part of the recording
+        sched.frames--;
+        replay_truncate(&recording, sched.frames);
+      }
+      memcpy(chip.KEYPAD, keypad, sizeof(keypad));
+      flush_display(&chip);
+      timer_delay_us(sched.frame_ticks);
+      sched.next_frame = timer_get_ticks();
+      continue;
+    }
+    run_frame(&sched);
+    rewind_push(&history, &chip);
+  }
+  return 0;
+}
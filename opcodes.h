@@ -0,0 +1,164 @@
+#ifndef OPCODES_H
+#define OPCODES_H
+// decoded CHIP-8 instructions shared by the dispatch engines
+//
+// every engine decodes the opcode fields once into an instr_t and then jumps
+// on instr_t.op instead of re-walking the opcode bits in nested switches
+
+// one entry per instruction the interpreter distinguishes; UNKNOWN must stay
+// first so zeroed table slots decode to it. besides CHIP-8 this covers the
+// SUPER-CHIP display, font and flag instructions and XO-CHIP's 00DN, FN01,
+// F002 and FX3A.
+// instructions whose behaviour depends on the quirk profile have one entry
+// per behaviour, so the choice is made once when decoding
+#define OPCODE_LIST(OP)                                                        \
+  OP(UNKNOWN)                                                                  \
+  OP(0NNN)                                                                     \
+  OP(00E0)                                                                     \
+  OP(00EE)                                                                     \
+  OP(00CN)                                                                     \
+  OP(00DN)                                                                     \
+  OP(00FB)                                                                     \
+  OP(00FC)                                                                     \
+  OP(00FD)                                                                     \
+  OP(00FE)                                                                     \
+  OP(00FF)                                                                     \
+  OP(1NNN)                                                                     \
+  OP(2NNN)                                                                     \
+  OP(3XNN)                                                                     \
+  OP(4XNN)                                                                     \
+  OP(5XY0)                                                                     \
+  OP(6XNN)                                                                     \
+  OP(7XNN)                                                                     \
+  OP(8XY0)                                                                     \
+  OP(8XY1)                                                                     \
+  OP(8XY2)                                                                     \
+  OP(8XY3)                                                                     \
+  OP(8XY4)                                                                     \
+  OP(8XY5)                                                                     \
+  OP(8XY6)                                                                     \
+  OP(8XY6_VY)                                                                  \
+  OP(8XY7)                                                                     \
+  OP(8XYE)                                                                     \
+  OP(8XYE_VY)                                                                  \
+  OP(9XY0)                                                                     \
+  OP(ANNN)                                                                     \
+  OP(BNNN)                                                                     \
+  OP(BXNN)                                                                     \
+  OP(CXNN)                                                                     \
+  OP(DXYN)                                                                     \
+  OP(EX9E)                                                                     \
+  OP(EXA1)                                                                     \
+  OP(FN01)                                                                     \
+  OP(F002)                                                                     \
+  OP(FX07)                                                                     \
+  OP(FX0A)                                                                     \
+  OP(FX15)                                                                     \
+  OP(FX18)                                                                     \
+  OP(FX1E)                                                                     \
+  OP(FX29)                                                                     \
+  OP(FX30)                                                                     \
+  OP(FX33)                                                                     \
+  OP(FX3A)                                                                     \
+  OP(FX55)                                                                     \
+  OP(FX55_INC)                                                                 \
+  OP(FX65)                                                                     \
+  OP(FX65_INC)                                                                 \
+  OP(FX75)                                                                     \
+  OP(FX85)
+
+// OP_STALE marks a predecoded entry whose memory has been written since it
+// was decoded; engines re-decode it the next time it is executed
+#define OP_ENUM(name) OP_##name,
+typedef enum { OPCODE_LIST(OP_ENUM) OP_STALE, NUM_OPS } op_t;
+#undef OP_ENUM
+
+typedef struct {
+  unsigned char op; // op_t
+  unsigned char x;
+  unsigned char y;
+  unsigned char n;
+  unsigned char nn;
+  unsigned short nnn;
+} instr_t;
+
+// platforms whose interpreters disagree on a few instructions; each program
+// runs under the profile of the platform it was written for
+//   CHIP8   COSMAC VIP: 8XY6/8XYE shift VY into VX, BNNN jumps to NNN + V0,
+//           FX55/FX65 leave I pointing past the last register
+//   SCHIP   SUPER-CHIP 1.1: shifts work on VX, BXNN jumps to XNN + VX, I is
+//           left unchanged
+//   XOCHIP  XO-CHIP as implemented by Octo: like CHIP8 for these
+typedef enum {
+  QUIRKS_CHIP8,
+  QUIRKS_SCHIP,
+  QUIRKS_XOCHIP,
+  NUM_QUIRKS
+} quirks_t;
+
+// op lookup by first nibble, by last nibble for 8XYN and by low byte for
+// FXNN, one table per quirk profile; groups 0 and E are resolved in
+// decode_op
+extern const unsigned char primary_ops[NUM_QUIRKS][16];
+extern const unsigned char alu_ops[NUM_QUIRKS][16];
+extern const unsigned char misc_ops[NUM_QUIRKS][256];
+
+static inline unsigned char decode_op(unsigned short opcode,
+                                      quirks_t quirks) {
+  switch (opcode >> 12) {
+  case 0x0:
+    if (opcode & 0x0F00) {
+      return OP_0NNN;
+    }
+    switch (opcode & 0x00F0) {
+    case 0xC0:
+      return OP_00CN;
+    case 0xD0:
+      return OP_00DN;
+    }
+    switch (opcode & 0x00FF) {
+    case 0xE0:
+      return OP_00E0;
+    case 0xEE:
+      return OP_00EE;
+    case 0xFB:
+      return OP_00FB;
+    case 0xFC:
+      return OP_00FC;
+    case 0xFD:
+      return OP_00FD;
+    case 0xFE:
+      return OP_00FE;
+    case 0xFF:
+      return OP_00FF;
+    }
+    return OP_0NNN;
+  case 0x8:
+    return alu_ops[quirks][opcode & 0x000F];
+  case 0xE:
+    switch (opcode & 0x00FF) {
+    case 0x9E:
+      return OP_EX9E;
+    case 0xA1:
+      return OP_EXA1;
+    }
+    return OP_UNKNOWN;
+  case 0xF:
+    return misc_ops[quirks][opcode & 0x00FF];
+  default:
+    return primary_ops[quirks][opcode >> 12];
+  }
+}
+
+static inline instr_t decode_instr(unsigned short opcode, quirks_t quirks) {
+  instr_t in;
+  in.op = decode_op(opcode, quirks);
+  in.x = (opcode & 0x0F00) >> 8;
+  in.y = (opcode & 0x00F0) >> 4;
+  in.n = opcode & 0x000F;
+  in.nn = opcode & 0x00FF;
+  in.nnn = opcode & 0x0FFF;
+  return in;
+}
+
+#endif
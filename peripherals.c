@@ -1,9 +1,13 @@
 #include "peripherals.h"
+#include "armtimer.h"
+#include "audio.h"
+#include "fb.h"
 #include "gl.h"
+#include "gpio.h"
+#include "gpio_extra.h"
+#include "gpio_interrupts.h"
 #include "interrupts.h"
 #include "keyboard.h"
-#include "malloc.h"
-#include "ps2.h"
 #include "ps2_keys.h"
 #include "strings.h"
 #include "timer.h"
@@ -17,134 +21,399 @@ int k_scale;
 int k_padding_x;
 int k_padding_y;
 
-ps2_device_t *keyboard;
+// scancode set 2 codes below this cover every key on the CHIP-8 keypad
+#define SCANCODE_LIMIT 0x80
+// hex keypad value for each scancode, or -1 when the key is not mapped
+signed char k_keypad_index[SCANCODE_LIMIT];
+// keyboard key for each hex keypad value
+static const unsigned char k_keypad_keys[16] = {
+    'x', '1', '2', '3', 'q', 'w', 'e', 'a',
+    's', 'd', 'z', 'c', '4', 'r', 'f', 'v'};
+
+// scancodes decoded by the PS/2 clock interrupt
+//
+// ps2_clock_edge is the only producer and set_keys the only consumer, so
+// each index is written by one side only and no lock is needed; the Pi A+
+// has a single core, so a compiler barrier is enough to publish a slot
+#define SCANCODE_QUEUE_SIZE 64 // power of two
+static volatile unsigned char k_scancode_queue[SCANCODE_QUEUE_SIZE];
+static volatile unsigned int k_queue_head; // written by the interrupt only
+static volatile unsigned int k_queue_tail; // written by set_keys only
+static volatile unsigned int k_scancodes_dropped;
+
+static void scancode_push(unsigned char code) {
+  unsigned int head = k_queue_head;
+  if (head - k_queue_tail == SCANCODE_QUEUE_SIZE) {
+    k_scancodes_dropped++;
+    return;
+  }
+  k_scancode_queue[head & (SCANCODE_QUEUE_SIZE - 1)] = code;
+  __asm__ volatile("" ::: "memory");
+  k_queue_head = head + 1;
+}
+
+static bool scancode_pop(unsigned char *code) {
+  unsigned int tail = k_queue_tail;
+  if (tail == k_queue_head) {
+    return false;
+  }
+  *code = k_scancode_queue[tail & (SCANCODE_QUEUE_SIZE - 1)];
+  __asm__ volatile("" ::: "memory");
+  k_queue_tail = tail + 1;
+  return true;
+}
+
+// PS/2 frame being received: start bit, 8 data bits (LSB first), odd
+// parity, stop bit, each sampled on a falling clock edge
+static unsigned int k_frame_bits;
+static unsigned int k_frame_data;
+static unsigned int k_frame_parity;
+static unsigned int k_last_edge;
+
+static void ps2_clock_edge(unsigned int pc, void *aux_data) {
+  gpio_clear_event(KEYBOARD_CLOCK);
+  unsigned int bit = gpio_read(KEYBOARD_DATA);
+  unsigned int now = timer_get_ticks();
+  // bits arrive every ~100us; a longer gap means we lost sync mid-frame
+  if (now - k_last_edge > 1000) {
+    k_frame_bits = 0;
+  }
+  k_last_edge = now;
+
+  if (k_frame_bits == 0) {
+    // wait for a start bit
+    if (bit == 0) {
+      k_frame_bits = 1;
+      k_frame_data = 0;
+      k_frame_parity = 0;
+    }
+  } else if (k_frame_bits < 9) {
+    k_frame_data |= bit << (k_frame_bits - 1);
+    k_frame_parity += bit;
+    k_frame_bits++;
+  } else if (k_frame_bits == 9) {
+    k_frame_parity += bit;
+    k_frame_bits++;
+  } else {
+    if (bit == 1 && k_frame_parity % 2 == 1) {
+      scancode_push(k_frame_data);
+    }
+    k_frame_bits = 0;
+  }
+}
 
 void init_keyboard(void) {
+  for (int code = 0; code < SCANCODE_LIMIT; code++) {
+    k_keypad_index[code] = -1;
+    for (int i = 0; i < 16; i++) {
+      if (ps2_keys[code].ch == k_keypad_keys[i]) {
+        k_keypad_index[code] = i;
+      }
+    }
+  }
+
   gpio_init();
-  keyboard_init(KEYBOARD_CLOCK, KEYBOARD_DATA);
-  keyboard = ps2_new(KEYBOARD_CLOCK, KEYBOARD_DATA);
-  while (true) {
-    if (keyboard_read_scancode() == 0xAA) {
-      ps2_write(keyboard, 0x55);
-      break;
+  gpio_set_input(KEYBOARD_CLOCK);
+  gpio_set_pullup(KEYBOARD_CLOCK);
+  gpio_set_input(KEYBOARD_DATA);
+  gpio_set_pullup(KEYBOARD_DATA);
+
+  interrupts_init();
+  gpio_interrupts_init();
+  gpio_enable_event_detection(KEYBOARD_CLOCK, GPIO_DETECT_FALLING_EDGE);
+  gpio_interrupts_register_handler(KEYBOARD_CLOCK, ps2_clock_edge, NULL);
+  gpio_interrupts_enable();
+  interrupts_global_enable();
+}
+
+// colour for each combination of plane bits (bit p = plane p)
+static const color_t k_palette[1 << DISPLAY_PLANES] = {
+    GL_BLACK, GL_WHITE, 0xFFAAAAAA, 0xFF555555};
+
+// rows are drawn SPAN_PIXELS pixels at a time from a table of their scaled
+// spans: entry (plane 1 bits << SPAN_PIXELS | plane 0 bits) holds the
+// SPAN_PIXELS * k_scale framebuffer pixels for those pixels, leftmost pixel
+// in the top bit. it is rebuilt whenever the scale changes
+#define SPAN_PIXELS 4
+#define SPAN_MASK ((1 << SPAN_PIXELS) - 1)
+#define MAX_SCALE (PHYSICAL_WIDTH / DISPLAY_WIDTH)
+static color_t k_spans[1 << (DISPLAY_PLANES * SPAN_PIXELS)]
+                      [SPAN_PIXELS * MAX_SCALE];
+
+static void build_spans(void) {
+  for (int bits = 0; bits < (1 << (DISPLAY_PLANES * SPAN_PIXELS)); bits++) {
+    color_t *span = k_spans[bits];
+    for (int shift = SPAN_PIXELS - 1; shift >= 0; shift--) {
+      unsigned int color = ((bits >> shift) & 1) |
+                           ((bits >> (SPAN_PIXELS + shift)) & 1) << 1;
+      for (int s = 0; s < k_scale; s++) {
+        *span++ = k_palette[color];
+      }
     }
   }
 }
 
-void init_display(int width, int height) {
+static void set_geometry(int width, int height) {
   k_display_width = width;
   k_display_height = height;
   k_scale = PHYSICAL_WIDTH / k_display_width;
   k_padding_x = (PHYSICAL_WIDTH - k_scale * k_display_width) / 2;
   k_padding_y = (PHYSICAL_HEIGHT - k_scale * k_display_height) / 2;
-  gl_init(PHYSICAL_WIDTH, PHYSICAL_HEIGHT, GL_SINGLEBUFFER);
+  build_spans();
+}
+
+void init_display(int width, int height) {
+  set_geometry(width, height);
+  gl_init(PHYSICAL_WIDTH, PHYSICAL_HEIGHT, GL_DOUBLEBUFFER);
+  gl_clear(GL_BLACK);
+  gl_swap_buffer();
   gl_clear(GL_BLACK);
 }
 
-void clear_display(void) { gl_clear(GL_BLACK); }
+// rows redrawn into the buffer that is now on screen; the back buffer is one
+// frame behind and needs them too
+static uint64_t k_prev_dirty;
 
-void draw_pixel(int x, int y, bool is_on) {
-  gl_draw_rect(x * k_scale + k_padding_x, y * k_scale + k_padding_y, k_scale,
-               k_scale, is_on ? GL_WHITE : GL_BLACK);
-}
+// one scaled row, built once and copied to each of its k_scale scanlines
+static color_t k_scanline[PHYSICAL_WIDTH];
 
-struct ps2_device {
-  unsigned int clock;
-  unsigned int data;
-};
+// draws row y straight into the framebuffer at fb, the top left pixel of the
+// display area in the draw buffer, whose lines are pitch bytes apart
+static void draw_row(const uint64_t (*planes)[HIRES_HEIGHT][ROW_WORDS], int y,
+                     unsigned char *fb, unsigned int pitch) {
+  size_t span_bytes = SPAN_PIXELS * k_scale * sizeof(color_t);
+  unsigned char *out = (unsigned char *)k_scanline;
+  for (int w = 0; w * 64 < k_display_width; w++) {
+    uint64_t p0 = planes[0][y][w];
+    uint64_t p1 = planes[1][y][w];
+    for (int shift = 64 - SPAN_PIXELS; shift >= 0; shift -= SPAN_PIXELS) {
+      unsigned int bits = (p0 >> shift & SPAN_MASK) |
+                          (p1 >> shift & SPAN_MASK) << SPAN_PIXELS;
+      memcpy(out, k_spans[bits], span_bytes);
+      out += span_bytes;
+    }
+  }
+  size_t row_bytes = k_display_width * k_scale * sizeof(color_t);
+  unsigned char *line = fb + y * k_scale * pitch;
+  for (int i = 0; i < k_scale; i++, line += pitch) {
+    memcpy(line, k_scanline, row_bytes);
+  }
+}
 
-// incredibly bad hack to get keyboard working
-//
-// existing keyboard and PS/2 API do not return
-// until a key / scancode is read
-//
-// here is a minimal working version that has an internal
-// timeout to return no key pressed
-
-// has a 100us timeout
-unsigned int read_bit(ps2_device_t *dev) {
-  unsigned int start_time = timer_get_ticks();
-  while (gpio_read(dev->clock) == 0) {
-    continue;
-  }
-  while (gpio_read(dev->clock) == 1) {
-    if (timer_get_ticks() - start_time > 200) {
-      return 2;
+void update_display(const uint64_t (*planes)[HIRES_HEIGHT][ROW_WORDS],
+                    int width, int height, uint64_t dirty) {
+  // a mode switch marks every row dirty, so both buffers get redrawn at the
+  // new scale; the margins are cleared of whatever was there before
+  if (width != k_display_width || height != k_display_height) {
+    set_geometry(width, height);
+    gl_clear(GL_BLACK);
+    gl_swap_buffer();
+    gl_clear(GL_BLACK);
+  }
+  uint64_t rows = dirty | k_prev_dirty;
+  unsigned int pitch = fb_get_pitch();
+  unsigned char *fb = (unsigned char *)fb_get_draw_buffer() +
+                      k_padding_y * pitch + k_padding_x * sizeof(color_t);
+  for (int y = 0; y < k_display_height; y++) {
+    if (rows & ((uint64_t)1 << y)) {
+      draw_row(planes, y, fb, pitch);
     }
-    continue;
   }
-  return gpio_read(dev->data);
+  gl_swap_buffer();
+  k_prev_dirty = dirty;
 }
 
-unsigned char poll_ps2_scancode(ps2_device_t *dev) {
-  unsigned char scan_code = 0;
-  while (true) {
-    unsigned int start_bit = read_bit(dev);
-    while (start_bit != 0) {
-      if (start_bit == 2) {
-        return 0;
-      }
-      start_bit = read_bit(dev);
+void show_menu(const char *const *names, int count) {
+  int line = gl_get_char_height() * 3 / 2;
+  int indent = gl_get_char_width() * 3;
+  gl_clear(GL_BLACK);
+  gl_draw_string(line, line, "press a key to start a program:", GL_WHITE);
+  for (int i = 0; i < count && i < 16; i++) {
+    char key[2] = {k_keypad_keys[i], '\0'};
+    int y = (i + 3) * line;
+    gl_draw_string(line, y, key, GL_WHITE);
+    gl_draw_string(line + indent, y, names[i], GL_WHITE);
+  }
+  gl_swap_buffer();
+  // no geometry matches, so the next update_display clears the menu away
+  k_display_width = 0;
+}
+
+// held to step back through the rewind buffer
+#define REWIND_KEY '\b'
+static bool k_rewind_held;
+// pressed to print a report, e.g. the profiler counters
+#define REPORT_KEY PS2_KEY_F1
+static bool k_report_requested;
+// pressed to print the input log
+#define LOG_KEY PS2_KEY_F2
+static bool k_log_requested;
+// pressed to print the execution trace
+#define TRACE_KEY PS2_KEY_F3
+static bool k_trace_requested;
+// pressed to switch turbo mode on or off
+#define TURBO_KEY '\t'
+static bool k_turbo_requested;
+// pressed to go back to the menu
+#define MENU_KEY PS2_KEY_ESC
+static bool k_menu_requested;
+
+// prefixes seen so far for the sequence being decoded; a sequence can be
+// split across two calls
+static bool k_release;
+static bool k_extended;
+
+void set_keys(bool *keypad) {
+  unsigned char code;
+  while (scancode_pop(&code)) {
+    if (code == PS2_CODE_EXTENDED) {
+      k_extended = true;
+      continue;
     }
-    unsigned int i = 0;
-    unsigned int parity = 0;
-    while (i < 8) {
-      unsigned int bit = read_bit(dev);
-      scan_code |= (bit << i++);
-      parity += bit;
+    if (code == PS2_CODE_RELEASE) {
+      k_release = true;
+      continue;
     }
-    if ((parity + read_bit(dev)) % 2 == 1) {
-      if (read_bit(dev) == 1) {
-        break;
+    // extended keys (arrows, keypad enter, ...) share codes with the main
+    // block and are not part of the keypad
+    if (!k_extended && code < SCANCODE_LIMIT) {
+      if (k_keypad_index[code] >= 0) {
+        keypad[k_keypad_index[code]] = !k_release;
+      } else if (ps2_keys[code].ch == REWIND_KEY) {
+        k_rewind_held = !k_release;
+      } else if (ps2_keys[code].ch == REPORT_KEY && !k_release) {
+        k_report_requested = true;
+      } else if (ps2_keys[code].ch == LOG_KEY && !k_release) {
+        k_log_requested = true;
+      } else if (ps2_keys[code].ch == TRACE_KEY && !k_release) {
+        k_trace_requested = true;
+      } else if (ps2_keys[code].ch == TURBO_KEY && !k_release) {
+        k_turbo_requested = true;
+      } else if (ps2_keys[code].ch == MENU_KEY && !k_release) {
+        k_menu_requested = true;
       }
     }
+    k_release = false;
+    k_extended = false;
   }
-  return scan_code;
-}
-
-// note that blocking scancode read is used subsequently
-// so that entire sequences are read
-key_action_t poll_keyboard_sequence(void) {
-  key_action_t action;
-  unsigned char keycode = poll_ps2_scancode(keyboard);
-  switch (keycode) {
-  case PS2_CODE_EXTENDED:
-    keycode = ps2_read(keyboard);
-    if (keycode == PS2_CODE_RELEASE) {
-      action.what = KEY_RELEASE;
-      action.keycode = ps2_read(keyboard);
-    } else {
-      action.what = KEY_PRESS;
-      action.keycode = keycode;
+}
+
+bool rewind_held(void) { return k_rewind_held; }
+
+bool report_requested(void) {
+  bool requested = k_report_requested;
+  k_report_requested = false;
+  return requested;
+}
+
+bool log_requested(void) {
+  bool requested = k_log_requested;
+  k_log_requested = false;
+  return requested;
+}
+
+bool trace_requested(void) {
+  bool requested = k_trace_requested;
+  k_trace_requested = false;
+  return requested;
+}
+
+bool turbo_requested(void) {
+  bool requested = k_turbo_requested;
+  k_turbo_requested = false;
+  return requested;
+}
+
+bool menu_requested(void) {
+  bool requested = k_menu_requested;
+  k_menu_requested = false;
+  return requested;
+}
+
+// sound goes out on PWM channel 1, the left side of the headphone jack
+// (GPIO 40), as one PWM period per sample. the clock manager divides the
+// 19.2 MHz oscillator down to PWM_CLOCK_HZ, so the range (period) is
+// PWM_CLOCK_HZ / AUDIO_SAMPLE_RATE clocks
+#define CM_PWMCTL ((volatile unsigned int *)0x201010A0)
+#define CM_PWMDIV ((volatile unsigned int *)0x201010A4)
+#define CM_PASSWORD 0x5A000000
+#define CM_ENABLE 0x10
+#define CM_BUSY 0x80
+#define CM_SOURCE_OSCILLATOR 1
+#define PWM_CLOCK_HZ 9600000
+#define PWM_CTL ((volatile unsigned int *)0x2020C000)
+#define PWM_STA ((volatile unsigned int *)0x2020C004)
+#define PWM_RNG1 ((volatile unsigned int *)0x2020C010)
+#define PWM_FIF1 ((volatile unsigned int *)0x2020C018)
+#define PWM_CTL_PWEN1 0x01
+#define PWM_CTL_USEF1 0x20
+#define PWM_CTL_CLRF1 0x40
+#define PWM_CTL_MSEN1 0x80
+#define PWM_STA_FULL1 0x01
+#define PWM_RANGE (PWM_CLOCK_HZ / AUDIO_SAMPLE_RATE)
+
+static audio_t k_audio;
+static bool k_audio_ready;
+
+// the ARM timer interrupts every TICK_US, to top up the PWM FIFO (16
+// samples, 2 ms) and so that sleep_us wakes up to check the time even when
+// no key is pressed
+#define TICK_US 1000
+static bool k_tick_ready;
+
+static void tick(unsigned int pc, void *aux_data) {
+  armtimer_check_and_clear_interrupt();
+  if (k_audio_ready) {
+    uint8_t sample;
+    while (!(*PWM_STA & PWM_STA_FULL1) && audio_take(&k_audio, &sample)) {
+      *PWM_FIF1 = sample * PWM_RANGE / 256;
     }
-    break;
-  case PS2_CODE_RELEASE:
-    action.what = KEY_RELEASE;
-    action.keycode = ps2_read(keyboard);
-    break;
-  default:
-    action.keycode = keycode;
-    action.what = KEY_PRESS;
   }
-  return action;
 }
 
-void set_keys(bool *keypad) {
-  unsigned char keys[16] = {'x', '1', '2', '3', 'q', 'w', 'e', 'a',
-                            's', 'd', 'z', 'c', '4', 'r', 'f', 'v'};
-  key_action_t action = poll_keyboard_sequence();
-  if (action.keycode == 0) {
-    memset(keypad, false, 16);
+static void start_tick(void) {
+  if (k_tick_ready) {
     return;
   }
-  unsigned char key = ps2_keys[action.keycode].ch;
-  for (int i = 0; i < 16; i++) {
-    if (key == keys[i]) {
-      *(keypad + i) = action.what == KEY_PRESS ? true : false;
-    }
+  armtimer_init(TICK_US);
+  armtimer_enable();
+  armtimer_enable_interrupts();
+  interrupts_register_handler(INTERRUPTS_BASIC_ARM_TIMER_IRQ, tick, NULL);
+  interrupts_enable_source(INTERRUPTS_BASIC_ARM_TIMER_IRQ);
+  k_tick_ready = true;
+}
+
+void init_audio(void) {
+  audio_init(&k_audio);
+  gpio_set_function(GPIO_PIN40, GPIO_FUNC_ALT0);
+
+  *CM_PWMCTL = CM_PASSWORD | (*CM_PWMCTL & ~CM_ENABLE);
+  while (*CM_PWMCTL & CM_BUSY) {
   }
+  *CM_PWMDIV = CM_PASSWORD | (19200000 / PWM_CLOCK_HZ) << 12;
+  *CM_PWMCTL = CM_PASSWORD | CM_ENABLE | CM_SOURCE_OSCILLATOR;
+
+  *PWM_CTL = PWM_CTL_CLRF1;
+  *PWM_RNG1 = PWM_RANGE;
+  *PWM_CTL = PWM_CTL_PWEN1 | PWM_CTL_USEF1 | PWM_CTL_MSEN1;
+
+  k_audio_ready = true;
+  start_tick();
 }
 
-void play_sound(bool on) {
-  // not implemented
+void play_sound(bool on, const unsigned char *pattern, unsigned char pitch) {
+  audio_post(&k_audio, on, pattern, pitch);
+}
+
+void fill_audio(void) { audio_fill(&k_audio); }
+
+unsigned long audio_underruns(void) { return k_audio.underruns; }
+
+void sleep_us(unsigned int us) {
+  unsigned int start = timer_get_ticks();
+  start_tick();
+  while (timer_get_ticks() - start < us) {
+    // wait for interrupt, the ARM1176 CP15 form
+    __asm__ volatile("mcr p15, 0, %0, c7, c0, 4" : : "r"(0));
+  }
 }
@@ -1,18 +1,60 @@
 #ifndef PERIPHERALS_H
 #define PERIPHERALS_H
 
+#include "display.h"
 #include "stdbool.h"
+#include "stdint.h"
 
 void init_keyboard(void);
 
 void init_display(int width, int height);
 
-void clear_display(void);
+// redraws the rows flagged in dirty (bit y = row y) of a width x height
+// display and shows the result; planes[p][y] is row y of bitplane p, laid out
+// as described in display.h
+void update_display(const uint64_t (*planes)[HIRES_HEIGHT][ROW_WORDS],
+                    int width, int height, uint64_t dirty);
 
-void draw_pixel(int x, int y, bool is_on);
+// replaces the display with a list of names, entry i labelled with the key
+// for keypad value i; the next update_display call clears it
+void show_menu(const char *const *names, int count);
 
+// applies the key presses and releases received since the last call
 void set_keys(bool *keypad);
 
-void play_sound(bool on);
+// whether the rewind key (backspace) was down as of the last set_keys call
+bool rewind_held(void);
+
+// true once for every press of the report key (F1) seen by set_keys
+bool report_requested(void);
+
+// true once for every press of the input log key (F2) seen by set_keys
+bool log_requested(void);
+
+// true once for every press of the trace key (F3) seen by set_keys
+bool trace_requested(void);
+
+// true once for every press of the turbo key (tab) seen by set_keys
+bool turbo_requested(void);
+
+// true once for every press of the menu key (escape) seen by set_keys
+bool menu_requested(void);
+
+// sets up sound output; see audio.h for the pipeline
+void init_audio(void);
+
+// posts the buzzer state from the 60 Hz timer step: on or off, and while on
+// the XO-CHIP pattern (AUDIO_PATTERN_SIZE bytes) and pitch to play
+void play_sound(bool on, const unsigned char *pattern, unsigned char pitch);
+
+// makes the samples the output device will need next; call it between
+// frames, it never runs while instructions execute
+void fill_audio(void);
+
+// times the output device found no sample waiting since init_audio
+unsigned long audio_underruns(void);
+
+// waits us microseconds with the core halted between interrupts
+void sleep_us(unsigned int us);
 
 #endif
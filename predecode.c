@@ -0,0 +1,55 @@
+#include "predecode.h"
+
+// the quirk variants are filled in per profile, see quirks_t
+#define PRIMARY_OPS(bnnn)                                                      \
+  {                                                                            \
+    [0x1] = OP_1NNN, [0x2] = OP_2NNN, [0x3] = OP_3XNN, [0x4] = OP_4XNN,        \
+    [0x5] = OP_5XY0, [0x6] = OP_6XNN, [0x7] = OP_7XNN, [0x9] = OP_9XY0,        \
+    [0xA] = OP_ANNN, [0xB] = bnnn, [0xC] = OP_CXNN, [0xD] = OP_DXYN,           \
+  }
+
+#define ALU_OPS(shift_right, shift_left)                                       \
+  {                                                                            \
+    [0x0] = OP_8XY0, [0x1] = OP_8XY1, [0x2] = OP_8XY2,                         \
+    [0x3] = OP_8XY3, [0x4] = OP_8XY4, [0x5] = OP_8XY5,                         \
+    [0x6] = shift_right, [0x7] = OP_8XY7, [0xE] = shift_left,                  \
+  }
+
+#define MISC_OPS(store, load)                                                  \
+  {                                                                            \
+    [0x01] = OP_FN01, [0x02] = OP_F002, [0x07] = OP_FX07, [0x0A] = OP_FX0A,    \
+    [0x15] = OP_FX15, [0x18] = OP_FX18, [0x1E] = OP_FX1E, [0x29] = OP_FX29,    \
+    [0x30] = OP_FX30, [0x33] = OP_FX33, [0x3A] = OP_FX3A, [0x55] = store,      \
+    [0x65] = load, [0x75] = OP_FX75, [0x85] = OP_FX85,                         \
+  }
+
+const unsigned char primary_ops[NUM_QUIRKS][16] = {
+    [QUIRKS_CHIP8] = PRIMARY_OPS(OP_BNNN),
+    [QUIRKS_SCHIP] = PRIMARY_OPS(OP_BXNN),
+    [QUIRKS_XOCHIP] = PRIMARY_OPS(OP_BNNN),
+};
+
+const unsigned char alu_ops[NUM_QUIRKS][16] = {
+    [QUIRKS_CHIP8] = ALU_OPS(OP_8XY6_VY, OP_8XYE_VY),
+    [QUIRKS_SCHIP] = ALU_OPS(OP_8XY6, OP_8XYE),
+    [QUIRKS_XOCHIP] = ALU_OPS(OP_8XY6_VY, OP_8XYE_VY),
+};
+
+const unsigned char misc_ops[NUM_QUIRKS][256] = {
+    [QUIRKS_CHIP8] = MISC_OPS(OP_FX55_INC, OP_FX65_INC),
+    [QUIRKS_SCHIP] = MISC_OPS(OP_FX55, OP_FX65),
+    [QUIRKS_XOCHIP] = MISC_OPS(OP_FX55_INC, OP_FX65_INC),
+};
+
+void predecode(chip_t *chip, unsigned short addr) {
+  // the last byte of memory pairs with the first, as in emulate_cycle
+  unsigned short opcode =
+      chip->MEM[addr] << 8 | chip->MEM[(addr + 1) & (MEM_SIZE - 1)];
+  chip->PREDECODED[addr] = decode_instr(opcode, chip->QUIRKS);
+}
+
+void predecode_all(chip_t *chip) {
+  for (int addr = 0; addr < MEM_SIZE; addr++) {
+    predecode(chip, addr);
+  }
+}
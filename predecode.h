@@ -0,0 +1,37 @@
+#ifndef PREDECODE_H
+#define PREDECODE_H
+// predecoded instruction cache over chip_t.MEM
+//
+// load_program decodes every address once, so the dispatch engines read a
+// ready instr_t instead of fetching and decoding two bytes per instruction.
+// there is one entry per byte address so jumps to odd addresses still hit.
+// all writes to memory after loading must go through write_mem, which marks
+// the (up to two) entries covering the byte as OP_STALE and retires any
+// ahead-of-time compiled or run-time translated block containing it
+
+#include "aot.h"
+#include "hachip.h"
+#include "jit.h"
+#include "opcodes.h"
+
+// decodes the instruction starting at addr into chip->PREDECODED
+void predecode(chip_t *chip, unsigned short addr);
+
+// decodes all of memory
+void predecode_all(chip_t *chip);
+
+static inline void write_mem(chip_t *chip, unsigned short addr,
+                             unsigned char value) {
+  addr &= MEM_SIZE - 1;
+  chip->MEM[addr] = value;
+  chip->PREDECODED[addr].op = OP_STALE;
+  chip->PREDECODED[(addr - 1) & (MEM_SIZE - 1)].op = OP_STALE;
+  if (chip->COMPILED.covered[addr]) {
+    aot_invalidate(chip, addr);
+  }
+  if (chip->TRANSLATED != NULL && chip->TRANSLATED->covered[addr]) {
+    jit_invalidate(chip, addr);
+  }
+}
+
+#endif
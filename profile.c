@@ -0,0 +1,122 @@
+#include "profile.h"
+
+#ifdef PROFILING
+
+#include "dispatch.h"
+#include "predecode.h"
+#include "printf.h"
+#include "strings.h"
+
+#define OP_NAME(name) [OP_##name] = #name,
+static const char *const op_names[NUM_OPS] = {
+    OPCODE_LIST(OP_NAME)[OP_STALE] = "STALE"};
+#undef OP_NAME
+
+// share of whole in hundredths of a percent; the Pi printf has no floating
+// point, and scaling down first keeps part * 10000 within 32 bits
+static unsigned long basis_points(unsigned long part, unsigned long whole) {
+  while (whole > 0x3FFFF) {
+    part >>= 1;
+    whole >>= 1;
+  }
+  return whole == 0 ? 0 : part * 10000 / whole;
+}
+
+void profile_reset(profile_t *prof) {
+  memset(prof, 0, sizeof(*prof));
+  prof->min_frame_ticks = ~0u;
+}
+
+void profile_run(chip_t *chip, unsigned int count) {
+  profile_t *prof = chip->PROFILE;
+  while (count--) {
+    unsigned short pc = chip->PC & (MEM_SIZE - 1);
+    // count the instruction as what it is now, not as stale
+    if (chip->PREDECODED[pc].op == OP_STALE) {
+      predecode(chip, pc);
+    }
+    prof->op_counts[chip->PREDECODED[pc].op]++;
+    prof->pc_counts[pc]++;
+    prof->instructions++;
+    dispatch_table(chip, 1);
+  }
+}
+
+void profile_frame(profile_t *prof, unsigned int instructions,
+                   unsigned int ticks) {
+  profile_frame_t *frame = &prof->recent[prof->frames % PROFILE_FRAMES];
+  frame->instructions = instructions;
+  frame->ticks = ticks;
+  prof->frames++;
+  prof->frame_ticks += ticks;
+  if (ticks < prof->min_frame_ticks) {
+    prof->min_frame_ticks = ticks;
+  }
+  if (ticks > prof->max_frame_ticks) {
+    prof->max_frame_ticks = ticks;
+  }
+}
+
+void profile_print(const profile_t *prof) {
+  printf("     op        count       %%\n");
+  for (int op = 0; op < NUM_OPS; op++) {
+    unsigned long count = prof->op_counts[op];
+    if (count != 0) {
+      unsigned long share = basis_points(count, prof->instructions);
+      printf("%7s %12lu %4lu.%02lu\n", op_names[op], count, share / 100,
+             share % 100);
+    }
+  }
+
+  // repeated selection of the largest count left; this only runs on demand
+  printf("\naddress        count       %%\n");
+  unsigned long shown = ~0ul;
+  int shown_addr = -1;
+  for (int i = 0; i < PROFILE_HOT_SPOTS; i++) {
+    int best = -1;
+    for (int addr = 0; addr < MEM_SIZE; addr++) {
+      unsigned long count = prof->pc_counts[addr];
+      // ties are listed in address order
+      bool after_shown = count < shown || (count == shown && addr > shown_addr);
+      if (count != 0 && after_shown &&
+          (best < 0 || count > prof->pc_counts[best])) {
+        best = addr;
+      }
+    }
+    if (best < 0) {
+      break;
+    }
+    shown = prof->pc_counts[best];
+    shown_addr = best;
+    unsigned long share = basis_points(shown, prof->instructions);
+    printf("    %03x %12lu %4lu.%02lu\n", best, shown, share / 100,
+           share % 100);
+  }
+
+  if (prof->frames != 0) {
+    printf("\n%lu frames, ticks per frame: min %u avg %lu max %u\n",
+           prof->frames, prof->min_frame_ticks,
+           prof->frame_ticks / prof->frames, prof->max_frame_ticks);
+  }
+}
+
+void profile_print_csv(const profile_t *prof) {
+  for (int op = 0; op < NUM_OPS; op++) {
+    if (prof->op_counts[op] != 0) {
+      printf("op,%s,%lu\n", op_names[op], prof->op_counts[op]);
+    }
+  }
+  for (int addr = 0; addr < MEM_SIZE; addr++) {
+    if (prof->pc_counts[addr] != 0) {
+      printf("pc,%03x,%lu\n", addr, prof->pc_counts[addr]);
+    }
+  }
+  unsigned long first =
+      prof->frames > PROFILE_FRAMES ? prof->frames - PROFILE_FRAMES : 0;
+  for (unsigned long n = first; n < prof->frames; n++) {
+    const profile_frame_t *frame = &prof->recent[n % PROFILE_FRAMES];
+    printf("frame,%lu,%u,%u\n", n, frame->instructions, frame->ticks);
+  }
+}
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+// instruction profiler, built only with -DPROFILING
+//
+// profiling is switched on per chip by pointing chip_t.PROFILE at a
+// profile_t. run_frame then records how many instructions each frame ran and
+// how long it took, and running the chip with profile_run as its engine also
+// counts executions per op and per address. the regular engines have no
+// profiling code in them, so a chip that is not being profiled, or a build
+// without PROFILING, runs exactly as fast as before
+
+#ifdef PROFILING
+
+#include "hachip.h"
+#include "opcodes.h"
+
+// frames kept for the recent frame table
+#define PROFILE_FRAMES 64
+// addresses listed by profile_print
+#define PROFILE_HOT_SPOTS 16
+
+typedef struct {
+  // run, leaving out idle loop passes the scheduler skipped
+  unsigned int instructions;
+  // timer ticks spent on the frame, not counting the wait for the next one
+  unsigned int ticks;
+} profile_frame_t;
+
+typedef struct profile {
+  unsigned long op_counts[NUM_OPS];
+  unsigned long pc_counts[MEM_SIZE];
+  unsigned long instructions;
+
+  unsigned long frames;
+  unsigned long frame_ticks;
+  unsigned int min_frame_ticks;
+  unsigned int max_frame_ticks;
+  // the last PROFILE_FRAMES frames, indexed by frame number
+  profile_frame_t recent[PROFILE_FRAMES];
+} profile_t;
+
+void profile_reset(profile_t *prof);
+
+// engine that runs count instructions like dispatch_table, counting each one
+// in chip->PROFILE
+void profile_run(chip_t *chip, unsigned int count);
+
+// called by run_frame for every frame of a profiled chip
+void profile_frame(profile_t *prof, unsigned int instructions,
+                   unsigned int ticks);
+
+// summary tables: op histogram, hottest addresses and frame times
+void profile_print(const profile_t *prof);
+
+// every non-zero counter as comma-separated lines, for scripts:
+//   op,<name>,<count>  pc,<addr>,<count>  frame,<n>,<instructions>,<ticks>
+void profile_print_csv(const profile_t *prof);
+
+#endif
+
+#endif
@@ -0,0 +1,85 @@
+#include "replay.h"
+#include "printf.h"
+#include "strings.h"
+
+static uint16_t pack_keys(const bool *keypad) {
+  uint16_t keys = 0;
+  for (int i = 0; i < 16; i++) {
+    keys |= keypad[i] << i;
+  }
+  return keys;
+}
+
+void replay_init(replay_t *log, const char *rom, quirks_t quirks,
+                 uint32_t seed, unsigned int instructions_per_frame) {
+  memset(log->rom, 0, sizeof(log->rom));
+  for (int i = 0; i < REPLAY_NAME_SIZE - 1 && rom[i] != '\0'; i++) {
+    log->rom[i] = rom[i];
+  }
+  log->quirks = quirks;
+  log->seed = seed;
+  log->instructions_per_frame = instructions_per_frame;
+  log->frames = 0;
+  log->count = 0;
+  log->playing = false;
+  log->full = false;
+  log->next = 0;
+  log->keys = 0;
+}
+
+void replay_restart(replay_t *log) {
+  log->playing = true;
+  log->next = 0;
+  log->keys = 0;
+}
+
+void replay_record(replay_t *log, unsigned long frame, const bool *keypad) {
+  if (log->full) {
+    return;
+  }
+  uint16_t keys = pack_keys(keypad);
+  if (keys != log->keys) {
+    if (log->count == REPLAY_MAX_EVENTS) {
+      log->full = true;
+      return;
+    }
+    log->events[log->count].frame = frame;
+    log->events[log->count].keys = keys;
+    log->count++;
+    log->keys = keys;
+  }
+  log->frames = frame + 1;
+}
+
+void replay_play(replay_t *log, unsigned long frame, bool *keypad) {
+  while (log->next < log->count && log->events[log->next].frame <= frame) {
+    log->keys = log->events[log->next++].keys;
+  }
+  for (int i = 0; i < 16; i++) {
+    keypad[i] = (log->keys >> i) & 1;
+  }
+}
+
+void replay_truncate(replay_t *log, unsigned long frame) {
+  if (frame >= log->frames) {
+    return;
+  }
+  while (log->count > 0 && log->events[log->count - 1].frame >= frame) {
+    log->count--;
+  }
+  log->keys = log->count > 0 ? log->events[log->count - 1].keys : 0;
+  log->frames = frame;
+  log->full = false;
+}
+
+void replay_print(const replay_t *log) {
+  printf("replay %d %s %d %08x %u %u\n", REPLAY_VERSION, log->rom,
+         (int)log->quirks, (unsigned int)log->seed,
+         (unsigned int)log->instructions_per_frame,
+         (unsigned int)log->frames);
+  for (uint32_t i = 0; i < log->count; i++) {
+    printf("%u %04x\n", (unsigned int)log->events[i].frame,
+           log->events[i].keys);
+  }
+  printf("end\n");
+}
@@ -0,0 +1,72 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+// input record and replay
+//
+// a replay_t holds what it takes to run a session again exactly: the ROM and
+// its quirk profile, the random seed, the instructions per frame and every
+// change of the keypad, keyed by frame number. run_frame records into it or
+// plays it back (scheduler_t.replay), and a replayed run executes the same
+// instructions in the same order as the recorded one, on any engine
+//
+// logs are exchanged as text so they can be captured from the Pi's UART and
+// replayed on the host with bench -I:
+//   replay <version> <rom> <quirks> <seed> <instructions per frame> <frames>
+//   <frame> <keypad>    one line per event; seed and keypad in hex
+//   end
+
+#include "hachip.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define REPLAY_VERSION 1
+// events kept; recording stops when they run out
+#define REPLAY_MAX_EVENTS 4096
+#define REPLAY_NAME_SIZE 32
+
+typedef struct {
+  uint32_t frame;
+  // bit i = key i held from this frame on
+  uint16_t keys;
+} replay_event_t;
+
+typedef struct {
+  char rom[REPLAY_NAME_SIZE];
+  quirks_t quirks;
+  uint32_t seed;
+  uint32_t instructions_per_frame;
+  // frames covered by the log
+  uint32_t frames;
+  // events in frame order
+  uint32_t count;
+  replay_event_t events[REPLAY_MAX_EVENTS];
+  // false while recording
+  bool playing;
+  // set when recording ran out of events; frames stops at the last complete
+  // frame
+  bool full;
+  // next event to play
+  uint32_t next;
+  // keypad as of the last event recorded or played
+  uint16_t keys;
+} replay_t;
+
+// starts an empty log for recording a run that was set up with these values
+void replay_init(replay_t *log, const char *rom, quirks_t quirks,
+                 uint32_t seed, unsigned int instructions_per_frame);
+
+// switches the log to playback from frame 0
+void replay_restart(replay_t *log);
+
+// adds the keypad of a frame to the log if it changed
+void replay_record(replay_t *log, unsigned long frame, const bool *keypad);
+
+// sets keypad to its logged state for a frame; frames must not go backwards
+void replay_play(replay_t *log, unsigned long frame, bool *keypad);
+
+// forgets everything from frame on, after stepping back with rewind
+void replay_truncate(replay_t *log, unsigned long frame);
+
+// writes the log in the text format above
+void replay_print(const replay_t *log);
+
+#endif
@@ -0,0 +1,152 @@
+#include "rewind.h"
+#include "strings.h"
+
+// a frame is encoded as records of one header word, (skip << 16) | copy,
+// followed by copy words to XOR into the base after skipping skip words.
+// snapshots are far below 64K words, so neither count can overflow
+
+// keyframes are encoded against an all-zero image
+static const uint32_t zero_image[SNAPSHOT_WORDS];
+
+static uint32_t encode(const uint32_t *image, const uint32_t *base,
+                       uint32_t *code) {
+  uint32_t n = 0;
+  uint32_t pos = 0;
+  while (pos < SNAPSHOT_WORDS) {
+    uint32_t skip = 0;
+    while (pos < SNAPSHOT_WORDS && image[pos] == base[pos]) {
+      pos++;
+      skip++;
+    }
+    uint32_t *header = &code[n++];
+    uint32_t copy = 0;
+    while (pos < SNAPSHOT_WORDS && image[pos] != base[pos]) {
+      code[n++] = image[pos] ^ base[pos];
+      pos++;
+      copy++;
+    }
+    *header = skip << 16 | copy;
+  }
+  return n;
+}
+
+static void apply(const uint32_t *code, uint32_t words, uint32_t *image) {
+  const uint32_t *end = code + words;
+  uint32_t pos = 0;
+  while (code < end) {
+    uint32_t header = *code++;
+    pos += header >> 16;
+    for (uint32_t copy = header & 0xFFFF; copy > 0; copy--) {
+      image[pos++] ^= *code++;
+    }
+  }
+}
+
+// i-th held frame, 0 being the oldest
+static rewind_frame_t *frame(rewind_t *rw, unsigned int i) {
+  return &rw->frames[(rw->first + i) % REWIND_MAX_FRAMES];
+}
+
+// drops the oldest keyframe and the deltas that depend on it
+static void drop_oldest(rewind_t *rw) {
+  do {
+    rw->first = (rw->first + 1) % REWIND_MAX_FRAMES;
+    rw->count--;
+  } while (rw->count > 0 && frame(rw, 0)->since_keyframe != 0);
+}
+
+// finds room for words contiguous words after the newest frame, dropping
+// old frames as needed, and returns their offset
+static uint32_t reserve(rewind_t *rw, uint32_t words) {
+  for (;;) {
+    if (rw->count == 0) {
+      rw->head = 0;
+      return 0;
+    }
+    uint32_t tail = frame(rw, 0)->offset;
+    if (rw->head > tail) {
+      if (rw->head + words <= REWIND_ARENA_WORDS) {
+        return rw->head;
+      }
+      // too little left at the end; leave it unused and wrap
+      rw->head = 0;
+    } else if (rw->head + words < tail) {
+      return rw->head;
+    } else {
+      drop_oldest(rw);
+    }
+  }
+}
+
+void rewind_init(rewind_t *rw) {
+  rw->head = 0;
+  rw->first = 0;
+  rw->count = 0;
+}
+
+void rewind_push(rewind_t *rw, const chip_t *chip) {
+  snapshot_save(chip, &rw->current.snap);
+  if (rw->count == REWIND_MAX_FRAMES) {
+    drop_oldest(rw);
+  }
+
+  uint32_t since = 0;
+  if (rw->count > 0) {
+    since = frame(rw, rw->count - 1)->since_keyframe + 1;
+    if (since == REWIND_KEYFRAME_INTERVAL) {
+      since = 0;
+    }
+  }
+  uint32_t words = encode(rw->current.words,
+                          since == 0 ? zero_image : rw->keyframe.words,
+                          rw->code);
+  uint32_t offset = reserve(rw, words);
+  if (since != 0 && rw->count == 0) {
+    // making room dropped the keyframe this delta was taken against
+    since = 0;
+    words = encode(rw->current.words, zero_image, rw->code);
+    offset = reserve(rw, words);
+  }
+
+  memcpy(&rw->arena[offset], rw->code, words * sizeof(uint32_t));
+  rewind_frame_t *f = frame(rw, rw->count++);
+  f->offset = offset;
+  f->words = words;
+  f->since_keyframe = since;
+  rw->head = offset + words;
+  if (since == 0) {
+    rw->keyframe = rw->current;
+  }
+}
+
+bool rewind_step(rewind_t *rw, chip_t *chip) {
+  if (rw->count < 2) {
+    return false;
+  }
+  const rewind_frame_t *dropped = frame(rw, --rw->count);
+  rw->head = dropped->offset;
+
+  const rewind_frame_t *f = frame(rw, rw->count - 1);
+  if (dropped->since_keyframe == 0) {
+    // back across a keyframe: deltas from here on are against the previous
+    // one
+    const rewind_frame_t *key = frame(rw, rw->count - 1 - f->since_keyframe);
+    memset(rw->keyframe.words, 0, sizeof(rw->keyframe.words));
+    apply(&rw->arena[key->offset], key->words, rw->keyframe.words);
+  }
+  rw->current = rw->keyframe;
+  if (f->since_keyframe != 0) {
+    apply(&rw->arena[f->offset], f->words, rw->current.words);
+  }
+  return snapshot_restore(chip, &rw->current.snap);
+}
+
+unsigned int rewind_frames(const rewind_t *rw) { return rw->count; }
+
+uint32_t rewind_words_used(const rewind_t *rw) {
+  uint32_t used = 0;
+  for (unsigned int i = 0; i < rw->count; i++) {
+    used += rw->frames[(rw->first + i) % REWIND_MAX_FRAMES].words;
+  }
+  return used;
+}
@@ -0,0 +1,68 @@
+#ifndef REWIND_H
+#define REWIND_H
+// rewind buffer: the last few seconds of frames in a fixed amount of memory
+//
+// every REWIND_KEYFRAME_INTERVAL frames a full snapshot (keyframe) is
+// stored; the frames in between are stored as the XOR of their snapshot with
+// that keyframe, run-length encoded a word at a time. consecutive frames
+// rarely touch more than a few bytes of RAM and a few display rows, so most
+// of a delta is a single skip. the oldest keyframe and its deltas are dropped
+// when the arena or the frame table fills up
+
+#include "hachip.h"
+#include "snapshot.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define REWIND_KEYFRAME_INTERVAL 60
+// frame table size, 10 seconds at 60 Hz
+#define REWIND_MAX_FRAMES 600
+#define REWIND_ARENA_WORDS (64 * 1024)
+
+#define SNAPSHOT_WORDS (sizeof(snapshot_t) / sizeof(uint32_t))
+
+// a snapshot seen as the words the encoder works on
+typedef union {
+  snapshot_t snap;
+  uint32_t words[SNAPSHOT_WORDS];
+} rewind_image_t;
+
+typedef struct {
+  // position and length of the encoded frame in the arena, in words
+  uint32_t offset;
+  uint32_t words;
+  // frames since the keyframe this one is a delta of; 0 for keyframes
+  uint32_t since_keyframe;
+} rewind_frame_t;
+
+typedef struct {
+  // encoded frames, oldest first, wrapping around at the end
+  uint32_t arena[REWIND_ARENA_WORDS];
+  uint32_t head;
+  // ring of frames; the oldest is always a keyframe
+  rewind_frame_t frames[REWIND_MAX_FRAMES];
+  unsigned int first;
+  unsigned int count;
+  // decoded keyframe of the newest frame, which new deltas are taken against
+  rewind_image_t keyframe;
+  // scratch space for the frame being encoded or decoded
+  rewind_image_t current;
+  uint32_t code[2 * SNAPSHOT_WORDS + 1];
+} rewind_t;
+
+void rewind_init(rewind_t *rw);
+
+// records the chip's state as the newest frame; called once per frame
+void rewind_push(rewind_t *rw, const chip_t *chip);
+
+// drops the newest frame and restores the one before it; returns false when
+// there is nothing older to go back to
+bool rewind_step(rewind_t *rw, chip_t *chip);
+
+// frames currently held
+unsigned int rewind_frames(const rewind_t *rw);
+
+// arena words used by the held frames
+uint32_t rewind_words_used(const rewind_t *rw);
+
+#endif
@@ -1,60 +1,24 @@
 #ifndef ROMS_H
 #define ROMS_H
+// catalog of the ROMs built into the binary
+//
+// the .ch8 files in roms/ are listed in roms/catalog.txt; the build turns the
+// list into roms.c, which holds each file as raw bytes, so a ROM goes into
+// memory with a plain copy (load_program)
 
-// https://github.com/loktar00/chip8/blob/master/roms/IBM%20Logo.ch8
-unsigned short IBM_LOGO[] = {
-    0x00e0, 0xa22a, 0x600c, 0x6108, 0xd01f, 0x7009, 0xa239, 0xd01f, 0xa248,
-    0x7008, 0xd01f, 0x7004, 0xa257, 0xd01f, 0x7008, 0xa266, 0xd01f, 0x7008,
-    0xa275, 0xd01f, 0x1228, 0xff00, 0xff00, 0x3c00, 0x3c00, 0x3c00, 0x3c00,
-    0xff00, 0xffff, 0x00ff, 0x0038, 0x003f, 0x003f, 0x0038, 0x00ff, 0x00ff,
-    0x8000, 0xe000, 0xe000, 0x8000, 0x8000, 0xe000, 0xe000, 0x80f8, 0x00fc,
-    0x003e, 0x003f, 0x003b, 0x0039, 0x00f8, 0x00f8, 0x0300, 0x0700, 0x0f00,
-    0xbf00, 0xfb00, 0xf300, 0xe300, 0x43e0, 0x00e0, 0x0080, 0x0080, 0x0080,
-    0x0080, 0x00e0, 0x00e0};
+#include "hachip.h"
+#include <stddef.h>
 
-// https://github.com/corax89/chip8-test-rom
-unsigned short TEST_ROM[] = {
-    0x124e, 0xeaac, 0xaaea, 0xceaa, 0xaaae, 0xe0a0, 0xa0e0, 0xc040, 0x40e0,
-    0xe020, 0xc0e0, 0xe060, 0x20e0, 0xa0e0, 0x2020, 0x6040, 0x2040, 0xe080,
-    0xe0e0, 0xe020, 0x2020, 0xe0e0, 0xa0e0, 0xe0e0, 0x20e0, 0x40a0, 0xe0a0,
-    0xe0c0, 0x80e0, 0xe080, 0xc080, 0xa040, 0xa0a0, 0xa202, 0xdab4, 0x00ee,
-    0xa202, 0xdab4, 0x13dc, 0x6801, 0x6905, 0x6a0a, 0x6b01, 0x652a, 0x662b,
-    0xa216, 0xd8b4, 0xa23e, 0xd9b4, 0xa202, 0x362b, 0xa206, 0xdab4, 0x6b06,
-    0xa21a, 0xd8b4, 0xa23e, 0xd9b4, 0xa206, 0x452a, 0xa202, 0xdab4, 0x6b0b,
-    0xa21e, 0xd8b4, 0xa23e, 0xd9b4, 0xa206, 0x5560, 0xa202, 0xdab4, 0x6b10,
-    0xa226, 0xd8b4, 0xa23e, 0xd9b4, 0xa206, 0x76ff, 0x462a, 0xa202, 0xdab4,
-    0x6b15, 0xa22e, 0xd8b4, 0xa23e, 0xd9b4, 0xa206, 0x9560, 0xa202, 0xdab4,
-    0x6b1a, 0xa232, 0xd8b4, 0xa23e, 0xd9b4, 0x2242, 0x6817, 0x691b, 0x6a20,
-    0x6b01, 0xa20a, 0xd8b4, 0xa236, 0xd9b4, 0xa202, 0xdab4, 0x6b06, 0xa22a,
-    0xd8b4, 0xa20a, 0xd9b4, 0xa206, 0x8750, 0x472a, 0xa202, 0xdab4, 0x6b0b,
-    0xa22a, 0xd8b4, 0xa20e, 0xd9b4, 0xa206, 0x672a, 0x87b1, 0x472b, 0xa202,
-    0xdab4, 0x6b10, 0xa22a, 0xd8b4, 0xa212, 0xd9b4, 0xa206, 0x6678, 0x671f,
-    0x8762, 0x4718, 0xa202, 0xdab4, 0x6b15, 0xa22a, 0xd8b4, 0xa216, 0xd9b4,
-    0xa206, 0x6678, 0x671f, 0x8763, 0x4767, 0xa202, 0xdab4, 0x6b1a, 0xa22a,
-    0xd8b4, 0xa21a, 0xd9b4, 0xa206, 0x668c, 0x678c, 0x8764, 0x4718, 0xa202,
-    0xdab4, 0x682c, 0x6930, 0x6a34, 0x6b01, 0xa22a, 0xd8b4, 0xa21e, 0xd9b4,
-    0xa206, 0x668c, 0x6778, 0x8765, 0x47ec, 0xa202, 0xdab4, 0x6b06, 0xa22a,
-    0xd8b4, 0xa222, 0xd9b4, 0xa206, 0x66e0, 0x866e, 0x46c0, 0xa202, 0xdab4,
-    0x6b0b, 0xa22a, 0xd8b4, 0xa236, 0xd9b4, 0xa206, 0x660f, 0x8666, 0x4607,
-    0xa202, 0xdab4, 0x6b10, 0xa23a, 0xd8b4, 0xa21e, 0xd9b4, 0xa3e8, 0x6000,
-    0x6130, 0xf155, 0xa3e9, 0xf065, 0xa206, 0x4030, 0xa202, 0xdab4, 0x6b15,
-    0xa23a, 0xd8b4, 0xa216, 0xd9b4, 0xa3e8, 0x6689, 0xf633, 0xf265, 0xa202,
-    0x3001, 0xa206, 0x3103, 0xa206, 0x3207, 0xa206, 0xdab4, 0x6b1a, 0xa20e,
-    0xd8b4, 0xa23e, 0xd9b4, 0x1248, 0x13dc};
+typedef struct {
+  const char *name;
+  const unsigned char *data;
+  size_t size;
+  // the platform the ROM was written for, passed to load_program
+  quirks_t quirks;
+} rom_t;
 
-// https://github.com/kripod/chip8-roms
-unsigned short TIMER_TEST[] = {0x6601, 0x221e, 0xf40a, 0x4402, 0x7301, 0x4408,
-                               0x8365, 0x3405, 0x1202, 0xf315, 0xf307, 0x221e,
-                               0x3300, 0x1214, 0x1202, 0x00e0, 0x6500, 0xa23a,
-                               0xf333, 0xf265, 0xf029, 0xd565, 0xf129, 0x6505,
-                               0xd565, 0xf229, 0x650a, 0xd565, 0x00ee};
+// in catalog order
+extern const rom_t ROMS[];
+extern const int NUM_ROMS;
 
-unsigned short KEYPAD_TEST[] = {
-    0x124e, 0x0819, 0x0101, 0x0801, 0x0f01, 0x0109, 0x0809, 0x0f09, 0x0111,
-    0x0811, 0x0f11, 0x0119, 0x0f19, 0x1601, 0x1609, 0x1611, 0x1619, 0xfcfc,
-    0xfcfc, 0xfcfc, 0xfc00, 0xa202, 0x820e, 0xf21e, 0x8206, 0xf165, 0x00ee,
-    0xa202, 0x820e, 0xf21e, 0x8206, 0xf155, 0x00ee, 0x6f10, 0xff15, 0xff07,
-    0x3f00, 0x1246, 0x00ee, 0x00e0, 0x6200, 0x222a, 0xf229, 0xd015, 0x70ff,
-    0x71ff, 0x2236, 0x7201, 0x3210, 0x1252, 0xf20a, 0x222a, 0xa222, 0xd017,
-    0x2242, 0xd017, 0x1264};
 #endif
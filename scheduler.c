@@ -0,0 +1,140 @@
+#include "scheduler.h"
+#include "predecode.h"
+#include "profile.h"
+#include "timer.h"
+
+// instructions run between checks for an idle loop
+#define IDLE_CHECK_INSTRUCTIONS 128
+
+void scheduler_init(scheduler_t *sched, chip_t *chip,
+                    unsigned int instructions_per_frame) {
+  sched->chip = chip;
+  sched->instructions_per_frame = instructions_per_frame;
+  sched->frame_ticks = FRAME_TICKS;
+  sched->run = emulate_cycles;
+  sched->replay = NULL;
+  sched->skip_idle = true;
+  sched->idle_instructions = 0;
+  sched->turbo = false;
+  sched->turbo_render = TURBO_RENDER_INTERVAL;
+  sched->wait = timer_delay_us;
+  sched->next_frame = timer_get_ticks();
+  sched->frames = 0;
+}
+
+static const instr_t *decoded(chip_t *chip, unsigned short addr) {
+  addr &= MEM_SIZE - 1;
+  if (chip->PREDECODED[addr].op == OP_STALE) {
+    predecode(chip, addr);
+  }
+  return &chip->PREDECODED[addr];
+}
+
+// length in instructions of the idle loop starting at PC, or 0 if PC is not
+// at one. an idle loop can only end once the keys or timers change, which
+// happens between frames, and every pass after the first leaves the machine
+// exactly as it found it:
+//   FX0A with no key held
+//   1NNN jumping to itself
+//   FX07, then 3XNN or 4XNN on the same VX skipping out of the loop, then a
+//   1NNN back to the FX07, while the delay timer keeps the skip from firing
+static unsigned int idle_loop(chip_t *chip) {
+  unsigned short pc = chip->PC;
+  const instr_t *in = decoded(chip, pc);
+  switch (in->op) {
+  case OP_FX0A:
+    for (int i = 0; i < 16; i++) {
+      if (chip->KEYPAD[i]) {
+        return 0;
+      }
+    }
+    return 1;
+  case OP_1NNN:
+    return in->nnn == pc ? 1 : 0;
+  case OP_FX07: {
+    const instr_t *test = decoded(chip, pc + 2);
+    const instr_t *back = decoded(chip, pc + 4);
+    if (back->op != OP_1NNN || back->nnn != pc || test->x != in->x) {
+      return 0;
+    }
+    if (test->op == OP_3XNN && chip->DELAY_TIMER != test->nn) {
+      return 3;
+    }
+    if (test->op == OP_4XNN && chip->DELAY_TIMER == test->nn) {
+      return 3;
+    }
+    return 0;
+  }
+  }
+  return 0;
+}
+
+// runs the frame's instructions, skipping whole passes of any idle loop; the
+// pass run first brings the machine into the state every later pass keeps,
+// and the remainder leaves PC where running it all would have. returns the
+// number of instructions run, which leaves out the skipped passes
+static unsigned int run_instructions(scheduler_t *sched) {
+  chip_t *chip = sched->chip;
+  unsigned int left = sched->instructions_per_frame;
+  while (left > 0) {
+    unsigned int loop = sched->skip_idle ? idle_loop(chip) : 0;
+    if (loop != 0 && left > loop) {
+      unsigned int skipped = (left / loop - 1) * loop;
+      sched->idle_instructions += skipped;
+      sched->run(chip, left - skipped);
+      return sched->instructions_per_frame - skipped;
+    }
+    unsigned int count =
+        left < IDLE_CHECK_INSTRUCTIONS ? left : IDLE_CHECK_INSTRUCTIONS;
+    sched->run(chip, count);
+    left -= count;
+  }
+  return sched->instructions_per_frame;
+}
+
+void run_frame(scheduler_t *sched) {
+  chip_t *chip = sched->chip;
+#ifdef PROFILING
+  unsigned int start = chip->PROFILE != NULL ? timer_get_ticks() : 0;
+#endif
+  if (sched->replay != NULL && sched->replay->playing) {
+    replay_play(sched->replay, sched->frames, chip->KEYPAD);
+  } else {
+    chip->IO->set_keys(chip, chip->KEYPAD);
+    if (sched->replay != NULL) {
+      replay_record(sched->replay, sched->frames, chip->KEYPAD);
+    }
+  }
+#ifdef PROFILING
+  unsigned int run = run_instructions(sched);
+#else
+  run_instructions(sched);
+#endif
+  tick_timers(chip);
+  // in turbo the rows changed by skipped frames stay in DIRTY for the next
+  // frame shown
+  if (!sched->turbo || (sched->turbo_render != 0 &&
+                        sched->frames % sched->turbo_render == 0)) {
+    flush_display(chip);
+  }
+  sched->frames++;
+#ifdef PROFILING
+  if (chip->PROFILE != NULL) {
+    profile_frame(chip->PROFILE, run, timer_get_ticks() - start);
+  }
+#endif
+
+  if (sched->frame_ticks == 0 || sched->turbo) {
+    // leaving turbo finds next_frame long past, which resets it below
+    return;
+  }
+  sched->next_frame += sched->frame_ticks;
+  int ahead = (int)(sched->next_frame - timer_get_ticks());
+  if (ahead > 0) {
+    sched->wait(ahead);
+  } else if (-ahead > (int)sched->frame_ticks) {
+    // more than a frame behind: drop the backlog instead of racing through
+    // it at full speed
+    sched->next_frame = timer_get_ticks();
+  }
+}
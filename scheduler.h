@@ -0,0 +1,60 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+// frame-based execution: each 60 Hz frame runs a fixed budget of
+// instructions in one batch, then services timers, input and display once
+// and waits for the next frame boundary, so emulated speed no longer depends
+// on how fast the host is or how often the timer is polled
+
+#include "hachip.h"
+#include "replay.h"
+
+// timer ticks (microseconds) per 60 Hz frame
+#define FRAME_TICKS 16667
+
+// roughly 700 instructions per second, a common speed for CHIP-8 games
+#define DEFAULT_INSTRUCTIONS_PER_FRAME 12
+
+// frames per displayed frame in turbo mode
+#define TURBO_RENDER_INTERVAL 8
+
+typedef struct {
+  chip_t *chip;
+  // instructions executed per frame
+  unsigned int instructions_per_frame;
+  // frame length in timer ticks; 0 runs frames back to back without waiting
+  unsigned int frame_ticks;
+  // engine used to run the batch, emulate_cycles by default
+  void (*run)(chip_t *chip, unsigned int count);
+  // skip the rest of a frame spent in an idle loop (see run_frame); on by
+  // default, and the machine ends up in the same state either way
+  bool skip_idle;
+  // instructions skipped that way
+  unsigned long idle_instructions;
+  // fast-forward: frames run back to back, without waiting, and only every
+  // turbo_render'th one is displayed (never if 0). timers still tick once
+  // per frame, so the program sees the same time pass as at normal speed
+  bool turbo;
+  unsigned int turbo_render;
+  // waits out the rest of a frame, timer_delay_us by default
+  void (*wait)(unsigned int us);
+  // input log to record the keypad into, or to take it from instead of
+  // set_keys when it is playing; NULL for neither
+  replay_t *replay;
+  // tick at which the next frame is due
+  unsigned int next_frame;
+  // frames run so far, which is also the number of the next one
+  unsigned long frames;
+} scheduler_t;
+
+void scheduler_init(scheduler_t *sched, chip_t *chip,
+                    unsigned int instructions_per_frame);
+
+// runs one frame and returns once it is time for the next one
+//
+// a program waiting for a key (FX0A), stuck in a jump to itself or polling
+// the delay timer (FX07) cannot get anywhere before the next frame changes
+// the keys and timers, so once one is seen the rest of the frame's budget is
+// accounted for without running it
+void run_frame(scheduler_t *sched);
+
+#endif
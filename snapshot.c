@@ -0,0 +1,77 @@
+#include "snapshot.h"
+#include "aot.h"
+#include "jit.h"
+#include "predecode.h"
+#include "strings.h"
+
+void snapshot_save(const chip_t *chip, snapshot_t *snap) {
+  snap->magic = SNAPSHOT_MAGIC;
+  snap->version = SNAPSHOT_VERSION;
+  memcpy(snap->PIXELS, chip->PIXELS, sizeof(snap->PIXELS));
+  memcpy(snap->MEM, chip->MEM, sizeof(snap->MEM));
+  snap->RNG = chip->RNG;
+  memcpy(snap->STACK, chip->STACK, sizeof(snap->STACK));
+  snap->I = chip->I;
+  snap->PC = chip->PC;
+  snap->SP = chip->SP;
+  memcpy(snap->V, chip->V, sizeof(snap->V));
+  for (int i = 0; i < 16; i++) {
+    snap->KEYPAD[i] = chip->KEYPAD[i];
+  }
+  memcpy(snap->FLAGS, chip->FLAGS, sizeof(snap->FLAGS));
+  snap->DELAY_TIMER = chip->DELAY_TIMER;
+  snap->SOUND_TIMER = chip->SOUND_TIMER;
+  snap->HIRES = chip->HIRES;
+  snap->PLANES = chip->PLANES;
+  snap->QUIRKS = chip->QUIRKS;
+  memcpy(snap->AUDIO, chip->AUDIO, sizeof(snap->AUDIO));
+  snap->PITCH = chip->PITCH;
+}
+
+bool snapshot_restore(chip_t *chip, const snapshot_t *snap) {
+  if (snap->magic != SNAPSHOT_MAGIC || snap->version != SNAPSHOT_VERSION) {
+    return false;
+  }
+  // states a few frames apart differ in a handful of bytes; only the
+  // decodings covering those go stale. restoring is not the program writing
+  // to its code, so rather than retire a compiled block per byte the whole
+  // program is matched against the restored memory once, which also brings
+  // back blocks an earlier write had retired
+  if (memcmp(chip->MEM, snap->MEM, sizeof(snap->MEM)) != 0) {
+    for (int addr = 0; addr < MEM_SIZE; addr++) {
+      if (chip->MEM[addr] != snap->MEM[addr]) {
+        chip->MEM[addr] = snap->MEM[addr];
+        chip->PREDECODED[addr].op = OP_STALE;
+        chip->PREDECODED[(addr - 1) & (MEM_SIZE - 1)].op = OP_STALE;
+      }
+    }
+    aot_reset(chip);
+    jit_reset(chip);
+  }
+  if (chip->QUIRKS != snap->QUIRKS) {
+    // the cached decodings and compiled blocks are for the old profile
+    chip->QUIRKS = snap->QUIRKS;
+    predecode_all(chip);
+    aot_reset(chip);
+    jit_reset(chip);
+  }
+  memcpy(chip->PIXELS, snap->PIXELS, sizeof(chip->PIXELS));
+  chip->DIRTY = ~(uint64_t)0;
+  chip->RNG = snap->RNG;
+  memcpy(chip->STACK, snap->STACK, sizeof(chip->STACK));
+  chip->I = snap->I;
+  chip->PC = snap->PC;
+  chip->SP = snap->SP;
+  memcpy(chip->V, snap->V, sizeof(chip->V));
+  for (int i = 0; i < 16; i++) {
+    chip->KEYPAD[i] = snap->KEYPAD[i];
+  }
+  memcpy(chip->FLAGS, snap->FLAGS, sizeof(chip->FLAGS));
+  chip->DELAY_TIMER = snap->DELAY_TIMER;
+  chip->SOUND_TIMER = snap->SOUND_TIMER;
+  chip->HIRES = snap->HIRES;
+  chip->PLANES = snap->PLANES;
+  memcpy(chip->AUDIO, snap->AUDIO, sizeof(chip->AUDIO));
+  chip->PITCH = snap->PITCH;
+  return true;
+}
@@ -0,0 +1,49 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+// save states
+//
+// a snapshot_t is the architectural state of a chip in a fixed layout with a
+// magic and version up front, so it can be written out and read back by a
+// later build. the caches (PREDECODED, COMPILED, TRANSLATED) and the
+// peripherals are not part of it; restoring brings the caches back in line
+// with the restored memory
+
+#include "hachip.h"
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SNAPSHOT_MAGIC 0x38504843 // "CHP8" in little endian
+// bump whenever the layout below changes
+#define SNAPSHOT_VERSION 5
+
+// fields are ordered largest first so there is no padding and the whole
+// struct is a multiple of 8 bytes; rewind.c diffs it one word at a time
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t PIXELS[DISPLAY_PLANES][HIRES_HEIGHT][ROW_WORDS];
+  uint8_t MEM[MEM_SIZE];
+  uint32_t RNG;
+  uint16_t STACK[16];
+  uint16_t I;
+  uint16_t PC;
+  uint16_t SP;
+  uint8_t V[16];
+  uint8_t KEYPAD[16];
+  uint8_t FLAGS[16];
+  uint8_t AUDIO[AUDIO_PATTERN_SIZE];
+  uint8_t DELAY_TIMER;
+  uint8_t SOUND_TIMER;
+  uint8_t HIRES;
+  uint8_t PLANES;
+  uint8_t QUIRKS;
+  uint8_t PITCH;
+} snapshot_t;
+
+void snapshot_save(const chip_t *chip, snapshot_t *snap);
+
+// returns false, leaving the chip untouched, if snap is not a snapshot of
+// this version
+bool snapshot_restore(chip_t *chip, const snapshot_t *snap);
+
+#endif
@@ -0,0 +1,144 @@
+#include "trace.h"
+#include "exec.h"
+#include "predecode.h"
+#include "printf.h"
+#include "strings.h"
+
+void trace_reset(trace_t *trace) { memset(trace, 0, sizeof(*trace)); }
+
+// what each op writes besides PC, known before it runs from its op and
+// operands; registers and memory not listed here are left alone
+#define WRITES_VX 1
+#define WRITES_VF 2
+// VX only when a key was down, else the instruction waits
+#define WRITES_VX_ON_KEY 4
+#define WRITES_V0_VX 8
+#define WRITES_MEM_3 16
+#define WRITES_MEM_V0_VX 32
+#define WRITES_I 64
+#define WRITES_SP 128
+static const unsigned char op_writes[NUM_OPS] = {
+    [OP_00EE] = WRITES_SP,
+    [OP_2NNN] = WRITES_SP,
+    [OP_6XNN] = WRITES_VX,
+    [OP_7XNN] = WRITES_VX,
+    [OP_8XY0] = WRITES_VX,
+    [OP_8XY1] = WRITES_VX,
+    [OP_8XY2] = WRITES_VX,
+    [OP_8XY3] = WRITES_VX,
+    [OP_8XY4] = WRITES_VX | WRITES_VF,
+    [OP_8XY5] = WRITES_VX | WRITES_VF,
+    [OP_8XY6] = WRITES_VX | WRITES_VF,
+    [OP_8XY6_VY] = WRITES_VX | WRITES_VF,
+    [OP_8XY7] = WRITES_VX | WRITES_VF,
+    [OP_8XYE] = WRITES_VX | WRITES_VF,
+    [OP_8XYE_VY] = WRITES_VX | WRITES_VF,
+    [OP_ANNN] = WRITES_I,
+    [OP_CXNN] = WRITES_VX,
+    [OP_DXYN] = WRITES_VF,
+    [OP_FX07] = WRITES_VX,
+    [OP_FX0A] = WRITES_VX_ON_KEY,
+    [OP_FX1E] = WRITES_VF | WRITES_I,
+    [OP_FX29] = WRITES_I,
+    [OP_FX30] = WRITES_I,
+    [OP_FX33] = WRITES_MEM_3,
+    [OP_FX55] = WRITES_MEM_V0_VX,
+    [OP_FX55_INC] = WRITES_MEM_V0_VX | WRITES_I,
+    [OP_FX65] = WRITES_V0_VX,
+    [OP_FX65_INC] = WRITES_V0_VX | WRITES_I,
+    [OP_FX85] = WRITES_V0_VX,
+};
+
+// completes entry for an instruction that has just run. writes is constant
+// in each case of trace_run, so only the stores an op needs are left
+static inline void record(const chip_t *chip, trace_entry_t *entry,
+                          const instr_t *in, unsigned int writes) {
+  if (writes & (WRITES_MEM_3 | WRITES_MEM_V0_VX)) {
+    // entry->i is still I from before the instruction
+    unsigned short from = entry->i & (MEM_SIZE - 1);
+    unsigned int length = writes & WRITES_MEM_3 ? 3 : in->x + 1;
+    entry->write_addr = from;
+    entry->write_len = length;
+    for (unsigned int k = 0; k < TRACE_VALUES && k < length; k++) {
+      entry->values[k] = chip->MEM[(from + k) & (MEM_SIZE - 1)];
+    }
+  }
+  if (writes & WRITES_I) {
+    entry->i = chip->I;
+  }
+  if (writes & WRITES_SP) {
+    entry->sp = chip->SP;
+  }
+  if ((writes & WRITES_VX_ON_KEY) &&
+      (chip->PC & (MEM_SIZE - 1)) != entry->pc) {
+    writes |= WRITES_VX;
+  }
+  // a VF written as VX as well is the one bit, its value the later one
+  if (writes & WRITES_VX) {
+    entry->written = 1 << in->x;
+    entry->values[0] = chip->V[in->x];
+  }
+  if ((writes & WRITES_VF) && (writes & WRITES_VX)) {
+    entry->written |= 1 << 0xF;
+    entry->values[in->x == 0xF ? 0 : 1] = chip->V[0xF];
+  } else if (writes & WRITES_VF) {
+    entry->written = 1 << 0xF;
+    entry->values[0] = chip->V[0xF];
+  }
+  if (writes & WRITES_V0_VX) {
+    entry->written = (2 << in->x) - 1;
+    memcpy(entry->values, chip->V, TRACE_VALUES);
+  }
+}
+
+void trace_run(chip_t *chip, unsigned int count) {
+  trace_t *trace = chip->TRACE;
+  // kept here, since every write to V or MEM may alias it; the stack ops,
+  // which can fail a TRACE_ASSERT, see it stored back before they run
+  unsigned long recorded = trace->count;
+  while (count--) {
+    unsigned short pc = chip->PC & (MEM_SIZE - 1);
+    const instr_t *in = &chip->PREDECODED[pc];
+    if (in->op == OP_STALE) {
+      predecode(chip, pc);
+    }
+    // filled in before running so an instruction that trips an assert is
+    // already in the dump; record adds what it wrote
+    trace_entry_t *entry = &trace->entries[recorded++ & (TRACE_ENTRIES - 1)];
+    entry->pc = pc;
+    entry->opcode = chip->MEM[pc] << 8 | chip->MEM[(pc + 1) & (MEM_SIZE - 1)];
+    entry->i = chip->I;
+    entry->written = 0;
+    entry->write_len = 0;
+    entry->sp = chip->SP;
+    chip->PC += 2;
+    switch (in->op) {
+#define OP_CASE(name)                                                          \
+  case OP_##name:                                                              \
+    if (op_writes[OP_##name] & WRITES_SP) {                                    \
+      trace->count = recorded;                                                 \
+    }                                                                          \
+    exec_##name(chip, in);                                                     \
+    record(chip, entry, in, op_writes[OP_##name]);                             \
+    break;
+      OPCODE_LIST(OP_CASE)
+#undef OP_CASE
+    }
+  }
+  trace->count = recorded;
+}
+
+void trace_dump(const chip_t *chip) {
+  const trace_t *trace = chip->TRACE;
+  unsigned long first =
+      trace->count > TRACE_ENTRIES ? trace->count - TRACE_ENTRIES : 0;
+  printf("trace %d %d %lu\n", TRACE_VERSION, chip->QUIRKS,
+         trace->count - first);
+  for (unsigned long n = first; n < trace->count; n++) {
+    const trace_entry_t *e = &trace->entries[n % TRACE_ENTRIES];
+    printf("%04x%04x%04x%04x%02x%02x%02x%02x%04x%02x%02x\n", e->pc, e->opcode,
+           e->i, e->written, e->values[0], e->values[1], e->values[2],
+           e->values[3], e->write_addr, e->write_len, e->sp);
+  }
+  printf("end\n");
+}
@@ -0,0 +1,72 @@
+#ifndef TRACE_H
+#define TRACE_H
+// execution trace
+//
+// tracing is switched on per chip by pointing chip_t.TRACE at a trace_t and
+// running the chip with trace_run as its engine. every instruction then adds
+// a fixed-size binary entry to a ring holding the last TRACE_ENTRIES: where
+// it ran, what it was and what it wrote. trace_run is an inlined switch like
+// dispatch_until; which registers and memory an instruction writes follows
+// from its op and operands, so each case stores just those after running
+// it, and the Pi leaves the tracer on.
+//
+// trace_dump prints the ring as text, which host/tracedump turns back into a
+// disassembly listing:
+//   trace <version> <quirks> <entries>
+//   <one line of 32 hex digits per entry, oldest first>
+//   end
+// each line is the fields of trace_entry_t in order, each in big endian
+
+#include "assert.h"
+#include "hachip.h"
+#include <stdint.h>
+
+#define TRACE_VERSION 2
+#define TRACE_ENTRIES 1024 // power of two
+// registers or bytes of memory whose new value an entry keeps; any others
+// written are only flagged
+#define TRACE_VALUES 4
+
+typedef struct {
+  uint16_t pc;
+  uint16_t opcode;
+  // I after the instruction
+  uint16_t i;
+  // V registers the instruction wrote, bit r = V[r]
+  uint16_t written;
+  // new values of the first TRACE_VALUES registers in written, lowest first,
+  // or of the first bytes of memory written; no instruction writes both
+  uint8_t values[TRACE_VALUES];
+  // memory written: write_len bytes from write_addr
+  uint16_t write_addr;
+  uint8_t write_len;
+  // stack depth after the instruction
+  uint8_t sp;
+} trace_entry_t;
+
+typedef struct trace {
+  // instructions recorded so far; the newest is at (count - 1) % TRACE_ENTRIES
+  unsigned long count;
+  trace_entry_t entries[TRACE_ENTRIES];
+} trace_t;
+
+void trace_reset(trace_t *trace);
+
+// engine that runs count instructions like dispatch_table, recording each one
+// in chip->TRACE
+void trace_run(chip_t *chip, unsigned int count);
+
+// prints chip->TRACE in the format above
+void trace_dump(const chip_t *chip);
+
+// assert that prints the trace of a traced chip before failing, so the
+// instructions that led up to it are not lost
+#define TRACE_ASSERT(chip, expr)                                               \
+  do {                                                                         \
+    if (!(expr) && (chip)->TRACE != NULL) {                                    \
+      trace_dump(chip);                                                        \
+    }                                                                          \
+    assert(expr);                                                              \
+  } while (0)
+
+#endif